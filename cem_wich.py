@@ -169,8 +169,9 @@ def initialize():
         # init
         lib.initialize.argtypes = [config.Config]
         lib.initialize.restype = c_int
-        lib.update.argtypes = [c_int]
-        lib.update.restype = POINTER(c_double)
+        lib.step.argtypes = [c_int]
+        lib.step.restype = c_int
+        lib.raster.restype = config.Raster
         lib.finalize.restype = c_int
 
         status = lib.initialize(input)
@@ -200,11 +201,14 @@ def update(timestep):
     # run CEM if not in GEE only mode
     if not mode == Modes.GEE:
         try:
-            out = lib.update(steps)
+            if lib.step(steps) != 0:
+                return throw_error("Error on run update")
+            raster = lib.raster()
         except:
             return throw_error("Error on run update")   
 
-        cem_grid = np.ctypeslib.as_array(out, shape=[globals.nRows, globals.nCols])
+        # view straight into the model's grid, valid until the next step
+        cem_grid = np.ctypeslib.as_array(raster.data, shape=[raster.nRows, raster.rowStride])[:, :raster.nCols]
         if np.any(np.isnan(cem_grid)) or not np.all(np.isfinite(cem_grid)):
             return throw_error("CEM returned NaN or Inf value")
         cem_shoreline = analyses.getShoreline(cem_grid)
@@ -4,218 +4,325 @@
 #include "BeachProperties.h"
 #include "consts.h"
 #include "utils.h"
+#include <limits.h>
 #include <math.h>
+#include <string.h>
 
-double g_cell_length, g_cell_width;
+/* ---- RASTER ----
+ * Rows and columns -1 and rows/cols are a ghost halo, so the neighbors
+ * of any cell on the grid can be addressed without bounds checks
+ */
+static double** AllocateRaster(int rows, int cols)
+{
+	double** row_ptrs = malloc((rows + 2) * sizeof(double*));
+	double* cells = calloc((size_t)(rows + 2) * (cols + 2), sizeof(double));
+	int r;
+	for (r = 0; r < rows + 2; r++)
+	{
+		row_ptrs[r] = cells + (size_t)r * (cols + 2) + 1;
+	}
+	return row_ptrs + 1;
+}
 
-static struct BeachGrid* SetCells(struct BeachGrid* this, struct BeachNode** cells)
+static void FreeRaster(double** frac_full)
 {
-	this->cells = cells;
-	return this;
+	free(frac_full[-1] - 1);
+	free(frac_full - 1);
 }
 
 static struct BeachNode* SetShoreline(struct BeachGrid* this, struct BeachNode* shoreline)
 {
 	this->shoreline = shoreline;
+	this->shoreline_version++;
 	return shoreline;
 }
 
-void FreeShoreline(struct BeachGrid* this)
+/* ---- SHORELINE NODE TABLE ----
+ * Open addressing (linear probing) from cell to its shoreline node, sized
+ * to the shoreline rather than the grid
+ */
+static unsigned int GetSlot(const struct BeachGrid* this, int row, int col)
 {
-	struct BeachNode* curr = this->shoreline;
-	while (!curr->is_boundary) {
-		free(curr->properties);
-		curr->properties = NULL;
-		if (!curr) { break; }
-		if (curr->prev && curr->prev->is_boundary)
+	unsigned int key = (unsigned int)row * (unsigned int)this->cols + (unsigned int)col;
+	return (key * 2654435761u) & (this->nodes_capacity - 1);
+}
+
+static struct BeachNode* TryGetNode(struct BeachGrid* this, int row, int col)
+{
+	if (this->num_nodes == 0)
+	{
+		return NULL;
+	}
+	unsigned int slot = GetSlot(this, row, col);
+	while (this->nodes[slot])
+	{
+		struct BeachNode* node = this->nodes[slot];
+		if (node->row == row && node->col == col)
 		{
-			free(curr->prev->properties);
-			free(curr->prev);
+			return node;
 		}
-		curr->prev = NULL;
-		struct BeachNode* next = curr->next;
-		curr->next = NULL;
-		curr = next;
+		slot = (slot + 1) & (this->nodes_capacity - 1);
 	}
+	return NULL;
+}
 
-	if (curr->is_boundary)
+static void InsertNode(struct BeachGrid* this, struct BeachNode* node)
+{
+	unsigned int slot = GetSlot(this, node->row, node->col);
+	while (this->nodes[slot])
 	{
-		free(curr->properties);
-		free(curr);
+		slot = (slot + 1) & (this->nodes_capacity - 1);
 	}
-	(*this).SetShoreline(this, NULL);
-
+	this->nodes[slot] = node;
+	this->num_nodes++;
 }
 
-static struct BeachNode* TryGetNode(struct BeachGrid* this, int row, int col)
+// keep the table at most half full
+static void ReserveNodes(struct BeachGrid* this, int num_nodes)
 {
-	if (row < 0 || row >= this->rows)
+	if (2 * num_nodes <= this->nodes_capacity)
 	{
-		return NULL;
+		return;
 	}
+	struct BeachNode** old_nodes = this->nodes;
+	int old_capacity = this->nodes_capacity;
 
-	if (col < 0 || col >= this->cols)
+	int capacity = old_capacity > 0 ? old_capacity : 64;
+	while (2 * num_nodes > capacity)
 	{
-		return NULL;
+		capacity *= 2;
 	}
+	this->nodes = calloc(capacity, sizeof(struct BeachNode*));
+	this->nodes_capacity = capacity;
+	this->num_nodes = 0;
 
-	return &(this->cells[row][col]);
+	int i;
+	for (i = 0; i < old_capacity; i++)
+	{
+		if (old_nodes[i])
+		{
+			InsertNode(this, old_nodes[i]);
+		}
+	}
+	free(old_nodes);
 }
 
-static double GetPrevAngle(struct BeachGrid* this, struct BeachNode* node)
+/**
+* Sediment only moves through node cells and their 4 neighbors, so the rows
+* around every node are marked for the next update of the land profile
+*/
+static void MarkLandDirty(struct BeachGrid* this, int row, int col)
 {
-	// error: node is null
-	if (!node)
+	struct LandProfile* profile = &this->profile;
+	if (!profile->is_built)
 	{
-		return EMPTY_double;
+		return;
+	}
+	int c;
+	for (c = col - 1; c <= col + 1; c++)
+	{
+		if (c < 0 || c >= this->cols) { continue; }
+		if (row - 1 < profile->dirty_top[c]) { profile->dirty_top[c] = row - 1; }
+		if (row + 1 > profile->dirty_bottom[c]) { profile->dirty_bottom[c] = row + 1; }
 	}
+}
 
-	if (node->properties->prev_timestamp == this->current_time)
+// widen the tracked rows of the columns around a node's cell to its 4 neighbors
+static void MarkChanged(struct BeachGrid* this, int row, int col)
+{
+	struct ChangeTracker* changes = &this->changes;
+	if (!changes->is_tracking)
+	{
+		return;
+	}
+	int c;
+	for (c = col - 1; c <= col + 1; c++)
 	{
-		return node->properties->prev_angle;
+		if (c < 0 || c >= this->cols) { continue; }
+		int top = c == col ? row - 1 : row;
+		int bottom = c == col ? row + 1 : row;
+		if (top < changes->top[c]) { changes->top[c] = top; }
+		if (bottom > changes->bottom[c]) { changes->bottom[c] = bottom; }
 	}
+}
 
-	double angle;
-	if (node->is_boundary)
+/**
+* Start tracking the rows that change from now on, forgetting earlier ones.
+* The current nodes' cells and neighbors are the first to change.
+* RETURN: stamp of this start
+*/
+static int TrackChanges(struct BeachGrid* this)
+{
+	struct ChangeTracker* changes = &this->changes;
+	if (!changes->top)
 	{
-		// start boundary node: prev is same as next->next
-		if (!node->prev && node->next)
-		{
-			angle = (*this).GetNextAngle(this, node->next);
-		}
-		// end boundary node: prev is same as prev->prev
-		else if (!node->next && node->prev)
-		{
-			angle = (*this).GetPrevAngle(this, node->prev);
-		}
-		// error: no valid neighbors
-		else
-		{
-			return EMPTY_double;
-		}
+		changes->top = malloc(this->cols * sizeof(int));
+		changes->bottom = malloc(this->cols * sizeof(int));
 	}
-	else if (node->prev->is_boundary)
+	int i;
+	for (i = 0; i < this->cols; i++)
 	{
-		// error: no valid neighbors
-		if (!node->next || node->next->is_boundary)
-		{
-			return EMPTY_double;
-		}
-		// start node: prev is same as next
-		angle = BeachNode.GetAngle(node, node->next);
+		changes->top[i] = this->rows;
+		changes->bottom[i] = -1;
 	}
-	else
+	changes->is_tracking = TRUE;
+	for (i = 0; i < this->nodes_capacity; i++)
 	{
-		// main case
-		angle = BeachNode.GetAngle(node->prev, node);
+		if (this->nodes[i])
+		{
+			MarkChanged(this, this->nodes[i]->row, this->nodes[i]->col);
+		}
 	}
-	node->properties->prev_angle = angle;
-	node->properties->prev_timestamp = this->current_time;
-	return angle;
+	return ++changes->stamp;
 }
 
-static double GetNextAngle(struct BeachGrid* this, struct BeachNode* node)
+/**
+* Create the shoreline node of a beach cell
+* RETURN: new node, NULL if the cell is off the grid
+*/
+static struct BeachNode* AddNode(struct BeachGrid* this, int row, int col)
 {
-	// error: node is null
-	if (!node)
+	if (row < 0 || row >= this->rows || col < 0 || col >= this->cols)
 	{
-		return EMPTY_double;
+		return NULL;
 	}
+	ReserveNodes(this, this->num_nodes + 1);
+	struct BeachNode* node = BeachNode.new(&this->node_pool, &this->frac_full[row][col], row, col);
+	InsertNode(this, node);
+	MarkLandDirty(this, row, col);
+	MarkChanged(this, row, col);
+	return node;
+}
 
-	if (node->properties->next_timestamp == this->current_time)
+static void RemoveNode(struct BeachGrid* this, struct BeachNode* node)
+{
+	unsigned int mask = this->nodes_capacity - 1;
+	unsigned int slot = GetSlot(this, node->row, node->col);
+	while (this->nodes[slot] != node)
 	{
-		return node->properties->next_angle;
+		slot = (slot + 1) & mask;
 	}
+	this->nodes[slot] = NULL;
+	this->num_nodes--;
 
-	double angle;
-	if (node->is_boundary)
+	// shift back entries that probed past the freed slot
+	unsigned int next = (slot + 1) & mask;
+	while (this->nodes[next])
 	{
-		// start boundary node: next is same as next->next
-		if (!node->prev && node->next)
-		{
-			angle = (*this).GetNextAngle(this, node->next);
-		}
-		// end boundary node: next is same as prev->prev
-		else if (!node->next && node->prev)
+		struct BeachNode* moved = this->nodes[next];
+		unsigned int home = GetSlot(this, moved->row, moved->col);
+		if (((next - home) & mask) >= ((next - slot) & mask))
 		{
-			angle = (*this).GetPrevAngle(this, node->prev);
-		}
-		else
-		{
-			// error: no valid neighbors
-			return EMPTY_double;
+			this->nodes[slot] = moved;
+			this->nodes[next] = NULL;
+			slot = next;
 		}
+		next = (next + 1) & mask;
 	}
-	else if (node->next->is_boundary)
+	BeachNode.free(&this->node_pool, node);
+}
+
+// drop every node at once: empty the table and recycle the pool
+void FreeShoreline(struct BeachGrid* this)
+{
+	if (this->num_nodes > 0)
 	{
-		// error: no valid neighbors
-		if (!node->prev || node->prev->is_boundary)
-		{
-			return EMPTY_double;
-		}
-		// end node: next is same as prev
-		angle = BeachNode.GetAngle(node->prev, node);
+		memset(this->nodes, 0, this->nodes_capacity * sizeof(struct BeachNode*));
+		this->num_nodes = 0;
 	}
-	else
+	NodePool.Reset(&this->node_pool);
+	(*this).SetShoreline(this, NULL);
+}
+
+static double* TryGetCell(struct BeachGrid* this, int row, int col)
+{
+	if (row < 0 || row >= this->rows)
+	{
+		return NULL;
+	}
+
+	if (col < 0 || col >= this->cols)
 	{
-		// main case
-		angle = BeachNode.GetAngle(node, node->next);
+		return NULL;
 	}
-	node->properties->next_angle = angle;
-	node->properties->next_timestamp = this->current_time;
-	return angle;
+
+	return &(this->frac_full[row][col]);
 }
 
-static double GetSurroundingAngle(struct BeachGrid* this, struct BeachNode* node)
+/**
+ * Prev, next and surrounding angles of every shoreline node, computed at the
+ * start of each timestep and read by the getters below until the next pass.
+ * Segment rise and run are gathered in one walk of the chain so the atan2
+ * calls run in one loop. End cells take their only segment for both angles
+ * and boundary nodes the angle of their neighboring cell.
+ */
+static void SetShorelineAngles(struct BeachGrid* this)
 {
-	// error: node is null
-	if (!node)
+	struct BeachNode* head = this->shoreline;
+	if (!head || head->is_boundary)
 	{
-		return EMPTY_double;
+		return;
 	}
 
-	if (node->properties->surrounding_timestamp == this->current_time)
+	int n = 0;
+	struct BeachNode* curr;
+	for (curr = head; !curr->is_boundary; curr = curr->next)
+	{
+		n++;
+	}
+	if (n > this->segments.capacity)
 	{
-		return node->properties->surrounding_angle;
+		this->segments.rise = realloc(this->segments.rise, n * sizeof(double));
+		this->segments.run = realloc(this->segments.run, n * sizeof(double));
+		this->segments.capacity = n;
 	}
 
-	double angle;
-	if (node->is_boundary)
+	// angle[i] from the (i)th to the (i + 1)th node, written over the rise
+	double* angle = this->segments.rise;
+	int i = 0;
+	for (curr = head; !curr->next->is_boundary; curr = curr->next)
 	{
-		if (!node->prev)
-		{
-			// error: next node is null
-			if (!node->next || node->next->is_boundary)
-			{
-				return EMPTY_double;
-			}
-			// start boundary: surrounding is same as next
-			angle = (*this).GetNextAngle(this, node->next);
-		}
-		else if (!node->next)
-		{
-			// error: prev node is null
-			if (!node->prev || node->prev->is_boundary)
-			{
-				return EMPTY_double;
-			}
-			// end boundary: surrounding is same as prev
-			angle = (*this).GetPrevAngle(this, node->prev);
-		}
+		BeachNode.GetSegment(this, curr->row, curr->col, *curr->frac_full,
+			curr->next->row, curr->next->col, *curr->next->frac_full, &this->segments.rise[i], &this->segments.run[i]);
+		i++;
 	}
-	// error: next or prev is null
-	else if (!node->prev || !node->next)
+	BeachNode.GetSegmentAngles(n - 1, this->segments.rise, this->segments.run, angle);
+
+	i = 0;
+	for (curr = head; !curr->is_boundary; curr = curr->next)
 	{
-		return EMPTY_double;
+		struct BeachProperties* properties = curr->properties;
+		properties->prev_angle = i > 0 ? angle[i - 1] : (n > 1 ? angle[0] : EMPTY_double);
+		properties->next_angle = i < n - 1 ? angle[i] : (n > 1 ? angle[n - 2] : EMPTY_double);
+		properties->surrounding_angle = (properties->prev_angle + properties->next_angle) / 2;
+		i++;
 	}
-	else
+
+	double first = head->properties->next_angle;
+	double last = curr->prev->properties->prev_angle;
+	if (head->prev)
 	{
-		// main case
-		angle = ((*this).GetPrevAngle(this, node) + (*this).GetNextAngle(this, node)) / 2;
+		head->prev->properties->prev_angle = head->prev->properties->next_angle = head->prev->properties->surrounding_angle = first;
 	}
-	node->properties->surrounding_angle = angle;
-	node->properties->surrounding_timestamp = this->current_time;
-	return angle;
+	curr->properties->prev_angle = curr->properties->next_angle = curr->properties->surrounding_angle = last;
+}
+
+static double GetPrevAngle(struct BeachGrid* this, struct BeachNode* node)
+{
+	(void)this;
+	return node ? node->properties->prev_angle : EMPTY_double;
+}
+
+static double GetNextAngle(struct BeachGrid* this, struct BeachNode* node)
+{
+	(void)this;
+	return node ? node->properties->next_angle : EMPTY_double;
+}
+
+static double GetSurroundingAngle(struct BeachGrid* this, struct BeachNode* node)
+{
+	(void)this;
+	return node ? node->properties->surrounding_angle : EMPTY_double;
 }
 
 static double GetAngleByDifferencingScheme(struct BeachGrid* this, struct BeachNode* node, double wave_angle)
@@ -279,43 +386,211 @@ static double GetAngleByDifferencingScheme(struct BeachGrid* this, struct BeachN
 	return downwind_angle;
 }
 
-static struct BeachNode** Get4Neighbors(struct BeachGrid* this, struct BeachNode* node)
+/**
+* frac_full entries of the 4 neighbors of a cell node (left, down, right, up).
+* Off-grid neighbors are halo cells, filled per the open boundary policy:
+* empty next to an overfull node so the excess leaves the grid, else full
+* so a deficit is made up from outside.
+*/
+static void Get4Neighbors(struct BeachGrid* this, struct BeachNode* node, double* neighbors[4])
+{
+	int myCol = node->col;
+	int myRow = node->row;
+	neighbors[0] = &this->frac_full[myRow][myCol - 1];
+	neighbors[1] = &this->frac_full[myRow + 1][myCol];
+	neighbors[2] = &this->frac_full[myRow][myCol + 1];
+	neighbors[3] = &this->frac_full[myRow - 1][myCol];
+
+	double outside = *node->frac_full > 1.0 ? 0.0 : 1.0;
+	if (myCol == 0) { *neighbors[0] = outside; }
+	if (myRow == this->rows - 1) { *neighbors[1] = outside; }
+	if (myCol == this->cols - 1) { *neighbors[2] = outside; }
+	if (myRow == 0) { *neighbors[3] = outside; }
+}
+
+/* ---- LAND PROFILE ---- */
+
+// first full row of column c from row r down, rows if none
+static int FindTopRow(struct BeachGrid* this, int c, int r)
 {
-	struct BeachNode** neighbors = malloc(4 * sizeof(struct BeachNode*));
-	int myCol = node->GetCol(node);
-	int myRow = node->GetRow(node);
-	int cols[4] = { myCol - 1, myCol, myCol + 1, myCol };
-	int rows[4] = { myRow, myRow + 1, myRow, myRow - 1 };
+	for (; r < this->rows; r++)
+	{
+		if (this->frac_full[r][c] == 1)
+		{
+			return r;
+		}
+	}
+	return this->rows;
+}
 
+// forget the marked rows, then mark the rows around the current nodes
+static void ResetLandDirty(struct BeachGrid* this)
+{
+	struct LandProfile* profile = &this->profile;
 	int i;
-	for (i = 0; i < 4; i++)
+	for (i = 0; i < this->cols; i++)
 	{
-		neighbors[i] = TryGetNode(this, rows[i], cols[i]);
-		if (!neighbors[i]) {
-			struct BeachNode* neighbor = BeachNode.boundary(EMPTY_INT, EMPTY_INT);
-			neighbor->frac_full = node->frac_full > 1.0 ? 0.0 : 1.0;
-			neighbors[i] = neighbor;
+		profile->dirty_top[i] = this->rows;
+		profile->dirty_bottom[i] = -1;
+	}
+	for (i = 0; i < this->nodes_capacity; i++)
+	{
+		if (this->nodes[i])
+		{
+			MarkLandDirty(this, this->nodes[i]->row, this->nodes[i]->col);
 		}
 	}
+}
+
+static void BuildLandProfile(struct BeachGrid* this)
+{
+	struct LandProfile* profile = &this->profile;
+	if (!profile->top)
+	{
+		profile->top = malloc(this->cols * sizeof(int));
+		profile->first = malloc(this->rows * sizeof(int));
+		profile->last = malloc(this->rows * sizeof(int));
+		profile->dirty_top = malloc(this->cols * sizeof(int));
+		profile->dirty_bottom = malloc(this->cols * sizeof(int));
+	}
 
-	return neighbors;
+	int r, c;
+	for (c = 0; c < this->cols; c++)
+	{
+		profile->top[c] = this->rows;
+	}
+	for (r = 0; r < this->rows; r++)
+	{
+		profile->first[r] = this->cols;
+		profile->last[r] = -1;
+		for (c = 0; c < this->cols; c++)
+		{
+			if (this->frac_full[r][c] == 1)
+			{
+				profile->first[r] = c < profile->first[r] ? c : profile->first[r];
+				profile->last[r] = c;
+				profile->top[c] = r < profile->top[c] ? r : profile->top[c];
+			}
+		}
+	}
+	profile->is_built = TRUE;
+	ResetLandDirty(this);
 }
 
-static int CheckIfInShadow(struct BeachGrid* this, struct BeachNode* node, double wave_angle)
+/**
+* Bring the profile up to date with the rows marked since the last update,
+* building it on first use. Marks are kept for the shadow cache; reset them
+* with ResetLandDirty once every user has seen them.
+*/
+static void UpdateLandProfile(struct BeachGrid* this)
 {
-	if (node->is_boundary)
+	struct LandProfile* profile = &this->profile;
+	if (!profile->is_built)
 	{
-		return FALSE;
+		BuildLandProfile(this);
+		return;
 	}
 
-	if (node->properties->shadow_timestamp == this->current_time)
+	int r, c, i;
+	for (c = 0; c < this->cols; c++)
 	{
-		return node->properties->in_shadow;
+		int top = profile->dirty_top[c] > 0 ? profile->dirty_top[c] : 0;
+		int bottom = profile->dirty_bottom[c] < this->rows ? profile->dirty_bottom[c] : this->rows - 1;
+		for (r = top; r <= bottom; r++)
+		{
+			if (this->frac_full[r][c] == 1)
+			{
+				profile->top[c] = r < profile->top[c] ? r : profile->top[c];
+				profile->first[r] = c < profile->first[r] ? c : profile->first[r];
+				profile->last[r] = c > profile->last[r] ? c : profile->last[r];
+				continue;
+			}
+
+			if (r == profile->top[c])
+			{
+				profile->top[c] = FindTopRow(this, c, r + 1);
+			}
+			// an outermost cell emptied, move the edge in to the next full cell
+			if (c == profile->first[r])
+			{
+				i = c + 1;
+				while (i <= profile->last[r] && this->frac_full[r][i] != 1) { i++; }
+				profile->first[r] = i;
+			}
+			else if (c == profile->last[r])
+			{
+				i = c - 1;
+				while (i >= profile->first[r] && this->frac_full[r][i] != 1) { i--; }
+				profile->last[r] = i;
+			}
+			if (profile->first[r] > profile->last[r])
+			{
+				profile->first[r] = this->cols;
+				profile->last[r] = -1;
+			}
+		}
+	}
+}
+
+/* ---- SHADOW HORIZON ---- */
+#define HORIZON_EPSILON 1e-6
+
+// bucket holding a cell, by its offset across the rays
+static int GetHorizonBucket(const struct BeachGrid* this, double across)
+{
+	const struct ShadowHorizon* horizon = &this->horizon;
+	int b = (int)((across - horizon->origin) / horizon->width);
+	return b < 0 ? 0 : (b >= horizon->num_buckets ? horizon->num_buckets - 1 : b);
+}
+
+static double GetAcross(const struct BeachGrid* this, int row, int col)
+{
+	return col * this->cell_width * this->horizon.dy - row * this->cell_length * this->horizon.dx;
+}
+
+// range of buckets a ray starting at across can touch
+static void GetHorizonWindow(const struct BeachGrid* this, double across, int* lo, int* hi)
+{
+	const struct ShadowHorizon* horizon = &this->horizon;
+	double margin = horizon->width + HORIZON_EPSILON * (this->cell_width + this->cell_length);
+	*lo = (int)floor((across - margin - horizon->origin) / horizon->width);
+	*hi = (int)floor((across + margin - horizon->origin) / horizon->width);
+	*lo = *lo < 0 ? 0 : *lo;
+	*hi = *hi >= horizon->num_buckets ? horizon->num_buckets - 1 : *hi;
+}
+
+// furthest full cell along the rays of every bucket a ray at across can touch
+static double GetHorizonAcross(const struct BeachGrid* this, double across)
+{
+	int lo, hi;
+	GetHorizonWindow(this, across, &lo, &hi);
+
+	double furthest = -HUGE_VAL;
+	int b;
+	for (b = lo; b <= hi; b++)
+	{
+		furthest = this->horizon.furthest[b] > furthest ? this->horizon.furthest[b] : furthest;
 	}
+	return furthest;
+}
+
+static int IsHorizonSet(const struct BeachGrid* this, int node_r, double wave_angle)
+{
+	return this->horizon.is_set && this->horizon.wave_angle == wave_angle && node_r <= this->horizon.max_row;
+}
 
+/**
+* Walk the shadow ray of a cell. Without threshold, stop at the first full
+* cell that shades it. With threshold, walk every full cell on the ray and
+* store the frac_full below which the cell would be shaded (-HUGE_VAL if
+* none could shade it); the ray does not depend on the cell's own frac_full.
+* With a horizon set for the same wave angle, the ray stops as soon as no
+* full cell is left for it to reach.
+* RETURN: whether the cell is in shadow
+*/
+static int CastShadowRay(struct BeachGrid* this, int node_r, int node_c, double frac_full, double wave_angle, double* threshold)
+{
 	// start at corner TODO: switch to centroid
-	int node_r = node->GetRow(node);
-	int node_c = node->GetCol(node);
 	int row = node_r;
 	int col = node_c;
 	double r = (double)node_r;
@@ -325,287 +600,1117 @@ static int CheckIfInShadow(struct BeachGrid* this, struct BeachNode* node, doubl
 	int r_sign = cos_angle >= 0 ? -1 : 1;
 	int c_sign = sin_angle >= 0 ? -1 : 1;
 
-	node->properties->shadow_timestamp = this->current_time;
+	// distance to cross a whole cell, and the drift along the other axis meanwhile
+	double d_row = fabs((r_sign * this->cell_length) / cos_angle);
+	double d_col = fabs((c_sign * this->cell_width) / sin_angle);
+	double c_per_row = (c_sign * fabs(d_row * sin_angle)) / this->cell_width;
+	double r_per_col = (r_sign * fabs(d_col * cos_angle) / this->cell_length);
+	// whether r (c) sits on a cell edge, so the next crossing is a whole cell away
+	int on_row_edge = TRUE;
+	int on_col_edge = TRUE;
+
+	const struct ShadowHorizon* horizon = &this->horizon;
+	int bounded = IsHorizonSet(this, node_r, wave_angle);
+	const int* top = this->profile.top;
+	double furthest = -HUGE_VAL;
+	double slack = 0.0;
+	if (bounded)
+	{
+		furthest = GetHorizonAcross(this, GetAcross(this, node_r, node_c));
+		slack = horizon->reach + HORIZON_EPSILON * (this->cell_width + this->cell_length);
+	}
+
+	int in_shadow = FALSE;
+	if (threshold)
+	{
+		*threshold = -HUGE_VAL;
+	}
 
 	while (TRUE)
 	{
-		int next_r = trunc(row + r_sign);
-		int next_c = trunc(col + c_sign);
+		int next_r = row + r_sign;
+		int next_c = col + c_sign;
 
-		double d_r = fabs(((next_r - r) * g_cell_length) / cos_angle);
-		double d_c = fabs(((next_c - c) * g_cell_width) / sin_angle);
+		double d_r = on_row_edge ? d_row : fabs(((next_r - r) * this->cell_length) / cos_angle);
+		double d_c = on_col_edge ? d_col : fabs(((next_c - c) * this->cell_width) / sin_angle);
 
 		if (d_r < d_c)
 		{
+			c += on_row_edge ? c_per_row : (c_sign * fabs(d_r * sin_angle)) / this->cell_width;
 			r = (double)next_r;
-			c += (c_sign * fabs(d_r * sin_angle)) / g_cell_width;
+			on_row_edge = TRUE;
+			on_col_edge = FALSE;
 		}
 		else
 		{
+			r += on_col_edge ? r_per_col : (r_sign * fabs(d_c * cos_angle) / this->cell_length);
 			c = (double)next_c;
-			r += (r_sign * fabs(d_c * cos_angle) / g_cell_length);
+			on_col_edge = TRUE;
+			on_row_edge = FALSE;
 		}
 
 		if (r < 0 || r >= (*this).rows || c < 0 || c >= (*this).cols)
 		{
-			node->properties->in_shadow = FALSE;
-			break;
+			return in_shadow;
 		}
 
-		row = ceil(r);
-		col = floor(c);
+		row = on_row_edge ? next_r : ceil(r);
+		col = on_col_edge ? next_c : floor(c);
 
-		struct BeachNode* temp = TryGetNode(this, row, col);
+		double* temp = TryGetCell(this, row, col);
 		if (!temp)
 		{
-			node->properties->in_shadow = FALSE;
-			break;
+			return in_shadow;
 		}
 
-		if (temp->frac_full == 1 && (row - 1) < (node_r - (node->frac_full + fabs((col - node_c) / tan(wave_angle)))))
+		// ray has passed every full cell it could still visit
+		if (bounded && (c * this->cell_width * horizon->dx + r * this->cell_length * horizon->dy) - slack > furthest)
 		{
-			node->properties->in_shadow = TRUE;
-			break;
+			return in_shadow;
 		}
-	}
-	return node->properties->in_shadow;
-}
-
-int FindBeach(struct BeachGrid* this)
-{
-	// clear current shoreline if grid already has one
-	if (this->shoreline != NULL)
-	{
-		(*this).FreeShoreline(this);
-	}
-	
-	// start search downward from top left
-	int r, c;
-	for (c = 0; c < this->cols; c++) {
-		for (r = 1; r < this->rows; r++) {
-			struct BeachNode* node = (*this).TryGetNode(this, r, c);
-			if (!node) { return -1; }
-
-			// start tracing shoreline
-			if (node->frac_full != 0) {
-				struct BeachNode* startNode = node;
 
-				struct BeachNode* endNode = (*this).GetShoreline(this, startNode, NULL, 1, 0);
-				if (!endNode)
+		// cells above the land profile are open water
+		if ((!bounded || row >= top[col]) && *temp == 1)
+		{
+			double offset = fabs((col - node_c) / tan(wave_angle));
+			if ((row - 1) < (node_r - (frac_full + offset)))
+			{
+				if (!threshold)
 				{
-					return -1;
-				}
-
-				// set start boundary
-				struct BeachNode* startBoundary;
-				int startCol = startNode->GetCol(startNode);
-				int startRow = startNode->GetRow(startNode);
-				if (startCol == 0) { startBoundary = BeachNode.boundary(EMPTY_INT, -1); }
-				else if (startCol == this->cols - 1) { startBoundary = BeachNode.boundary(EMPTY_INT, this->cols); }
-				else if (startRow == 0) { startBoundary = BeachNode.boundary(-1, EMPTY_INT); }
-				else if (startRow == this->rows - 1) { startBoundary = BeachNode.boundary(this->rows, EMPTY_INT); }
-				else { // start not at grid boundary, invalid grid
-					return -1;
-				}
-				startNode->prev = startBoundary;
-				startBoundary->next = startNode;
-
-				// set end boundary
-				struct BeachNode* endBoundary;
-				int endCol = endNode->GetCol(endNode);
-				int endRow = endNode->GetRow(endNode);
-				if (endCol == 0) { endBoundary = BeachNode.boundary(EMPTY_INT, -1); }
-				else if (endCol == this->cols - 1) { endBoundary = BeachNode.boundary(EMPTY_INT, this->cols); }
-				else if (endRow == 0) { endBoundary = BeachNode.boundary(-1, EMPTY_INT); }
-				else if (endRow == this->rows - 1) { endBoundary = BeachNode.boundary(this->rows, EMPTY_INT); }
-				else { // end not at grid boundary, invalid grid
-					return -1;
+					return TRUE;
 				}
-				endNode->next = endBoundary;
-				endBoundary->prev = endNode;
-
-				(*this).SetShoreline(this, startNode);
-				return 0;
+				in_shadow = TRUE;
+			}
+			if (threshold && node_r - (row - 1) - offset > *threshold)
+			{
+				*threshold = node_r - (row - 1) - offset;
 			}
 		}
 	}
-	return -1;
 }
 
-static struct BeachNode* ReplaceNode(struct BeachGrid* this, struct BeachNode* node)
+/* ---- SHADOW CACHE ----
+ * While the wave angle stays the same from one step to the next, shadow
+ * thresholds of cells are kept across steps. A threshold stays valid until
+ * a full cell in one of the horizon buckets its ray can touch changes.
+ */
+#define SHADOW_TOLERANCE 1e-9
+
+static unsigned int GetShadowSlot(const struct BeachGrid* this, int key)
+{
+	return ((unsigned int)key * 2654435761u) & (this->shadow_cache.capacity - 1);
+}
+
+static struct ShadowEntry* FindShadowEntry(struct BeachGrid* this, int key)
 {
-	if (!node || node->is_boundary)
+	struct ShadowCache* cache = &this->shadow_cache;
+	unsigned int slot = GetShadowSlot(this, key);
+	while (cache->entries[slot].key != key && cache->entries[slot].key != EMPTY_INT)
 	{
-		return NULL;
+		slot = (slot + 1) & (cache->capacity - 1);
 	}
-	struct BeachNode* start = node->prev;
-	struct BeachNode* stop = node->next;
+	return &cache->entries[slot];
+}
 
-	struct BeachNode* curr = node;
+static void ClearShadowEntries(struct ShadowCache* cache, int capacity)
+{
+	if (capacity != cache->capacity)
+	{
+		free(cache->entries);
+		cache->entries = malloc(capacity * sizeof(struct ShadowEntry));
+		cache->capacity = capacity;
+	}
+	int i;
+	for (i = 0; i < capacity; i++)
+	{
+		cache->entries[i].key = EMPTY_INT;
+	}
+	cache->count = 0;
+}
 
-	// get start dir - default to up if prev is null or boundary
-	int dir_r = 1;
-	int dir_c = 0;
-	struct BeachNode* prev = start->prev;
-	if (prev && !prev->is_boundary)
+// keep the table at most half full
+static void ReserveShadowEntries(struct BeachGrid* this, int count)
+{
+	struct ShadowCache* cache = &this->shadow_cache;
+	if (2 * count <= cache->capacity)
 	{
-		// start from 45 clockwise of prev
-		double angle = atan2(-(prev->GetRow(prev) - start->GetRow(start)), prev->GetCol(prev) - start->GetCol(start));
-		dir_r = round(sin(angle));
-		dir_c = -round(cos(angle));
+		return;
 	}
+	struct ShadowEntry* old_entries = cache->entries;
+	int old_capacity = cache->capacity;
+	cache->entries = NULL;
+	cache->capacity = 0;
+	ClearShadowEntries(cache, old_capacity > 0 ? 2 * old_capacity : 1024);
 
-	struct BeachNode* endNode = (*this).GetShoreline(this, start, stop, dir_r, dir_c);
-	if (endNode != stop)
+	int i;
+	for (i = 0; i < old_capacity; i++)
 	{
-		// edge of grid - add boundary node
-		if (endNode->GetCol(endNode) == this->cols - 1)
+		if (old_entries[i].key != EMPTY_INT)
 		{
-			while (!stop->is_boundary)
-			{
-				struct BeachNode* next = stop->next;
-				free(stop->properties);
-				stop->properties = NULL;
-				stop->prev = NULL;
-				stop->next = NULL;
-				stop = next;
-			}
-			endNode->next = stop;
-			stop->prev = endNode;
+			*FindShadowEntry(this, old_entries[i].key) = old_entries[i];
+			cache->count++;
 		}
-		// error: didn't replace shoreline
-		else
+	}
+	free(old_entries);
+}
+
+// start keeping thresholds for the horizon just laid out
+static void StartShadowCache(struct BeachGrid* this)
+{
+	struct ShadowCache* cache = &this->shadow_cache;
+	if (!cache->was_full)
+	{
+		cache->was_full = malloc((size_t)this->rows * this->cols);
+	}
+	if (this->horizon.num_buckets > cache->buckets_capacity)
+	{
+		free(cache->changed_at);
+		cache->changed_at = malloc(this->horizon.num_buckets * sizeof(int));
+		cache->buckets_capacity = this->horizon.num_buckets;
+	}
+	int b;
+	for (b = 0; b < this->horizon.num_buckets; b++)
+	{
+		cache->changed_at[b] = 0;
+	}
+	ClearShadowEntries(cache, cache->capacity > 0 ? cache->capacity : 1024);
+	cache->scanned_rows = 0;
+	cache->stamp = 0;
+	cache->is_active = TRUE;
+}
+
+static int IsShadowEntryCurrent(const struct BeachGrid* this, const struct ShadowEntry* entry, int node_r, int node_c)
+{
+	int lo, hi, b;
+	GetHorizonWindow(this, GetAcross(this, node_r, node_c), &lo, &hi);
+	for (b = lo; b <= hi; b++)
+	{
+		if (this->shadow_cache.changed_at[b] > entry->stamp)
 		{
-			return NULL;
+			return FALSE;
 		}
-	}	
+	}
+	return TRUE;
+}
 
-	// reset shoreline head node if necessary
-	if (this->shoreline == node)
+/**
+* Whether a cell is shaded from waves approaching at wave_angle by full cells
+* further along the ray, without changing the grid: cells can be checked from
+* several threads at once. A threshold the shadow cache is missing for the
+* cell is left in kept for KeepCellShadow, else kept's key is EMPTY_INT.
+*/
+static int FindCellShadow(struct BeachGrid* this, int node_r, int node_c, double frac_full, double wave_angle, struct ShadowEntry* kept)
+{
+	struct ShadowCache* cache = &this->shadow_cache;
+	kept->key = EMPTY_INT;
+	if (!cache->is_active || !IsHorizonSet(this, node_r, wave_angle))
 	{
-		this->shoreline = start;
+		return CastShadowRay(this, node_r, node_c, frac_full, wave_angle, NULL);
 	}
 
-	// remove node from shoreline
-	free(node->properties);
-	node->properties = NULL;
-	node->prev = NULL;
-	node->next = NULL;
+	int key = node_r * this->cols + node_c;
+	struct ShadowEntry* entry = FindShadowEntry(this, key);
+	if (entry->key == key && IsShadowEntryCurrent(this, entry, node_r, node_c))
+	{
+		if (frac_full < entry->threshold - SHADOW_TOLERANCE)
+		{
+			return TRUE;
+		}
+		if (frac_full > entry->threshold + SHADOW_TOLERANCE)
+		{
+			return FALSE;
+		}
+		// too close to call from the stored threshold
+		return CastShadowRay(this, node_r, node_c, frac_full, wave_angle, NULL);
+	}
 
-	return stop;
+	double threshold;
+	int in_shadow = CastShadowRay(this, node_r, node_c, frac_full, wave_angle, &threshold);
+	kept->key = key;
+	kept->stamp = cache->stamp;
+	kept->threshold = threshold;
+	return in_shadow;
 }
 
+// store a threshold left by FindCellShadow in the shadow cache
+static void KeepCellShadow(struct BeachGrid* this, const struct ShadowEntry* kept)
+{
+	struct ShadowCache* cache = &this->shadow_cache;
+	if (kept->key == EMPTY_INT)
+	{
+		return;
+	}
+	struct ShadowEntry* entry = FindShadowEntry(this, kept->key);
+	if (entry->key != kept->key)
+	{
+		ReserveShadowEntries(this, cache->count + 1);
+		entry = FindShadowEntry(this, kept->key);
+		cache->count++;
+	}
+	*entry = *kept;
+}
 
 /**
-* Find shoreline between start and end cols using Moore tracing algorithm
+* Whether a cell is shaded from waves approaching at wave_angle by full cells
+* further along the ray. Uses the shadow horizon and cache when they are set
+* for this wave angle; results match the plain ray walk.
 */
-struct BeachNode* GetShoreline(struct BeachGrid* this, struct BeachNode* startNode, struct BeachNode* stopNode, int dir_r,  int dir_c)
+static int CheckIfCellInShadow(struct BeachGrid* this, int node_r, int node_c, double frac_full, double wave_angle)
 {
-	struct BeachNode* curr = startNode;
+	struct ShadowEntry kept;
+	int in_shadow = FindCellShadow(this, node_r, node_c, frac_full, wave_angle, &kept);
+	KeepCellShadow(this, &kept);
+	return in_shadow;
+}
 
-	// while not done tracing boundary
-	while (TRUE)
+// raise the furthest full cell of the bucket holding cell (r, c)
+static void AddHorizonCell(struct BeachGrid* this, int r, int c)
+{
+	struct ShadowHorizon* horizon = &this->horizon;
+	double along = c * this->cell_width * horizon->dx + r * this->cell_length * horizon->dy;
+	int b = GetHorizonBucket(this, GetAcross(this, r, c));
+	if (along > horizon->furthest[b])
+	{
+		horizon->furthest[b] = along;
+	}
+}
+
+// add the full cells of a row, recording their flags if caching
+static void ScanHorizonRow(struct BeachGrid* this, int r)
+{
+	struct ShadowCache* cache = &this->shadow_cache;
+	unsigned char* was_full = cache->is_active ? cache->was_full + (size_t)r * this->cols : NULL;
+	if (was_full)
 	{
-		// mark as beach
-		if (!curr) { return NULL; }
-		if (!curr->properties)
+		memset(was_full, 0, this->cols);
+	}
+
+	int c;
+	for (c = this->profile.first[r]; c <= this->profile.last[r]; c++)
+	{
+		if (this->frac_full[r][c] == 1)
 		{
-			struct BeachProperties* props = malloc(sizeof(struct BeachProperties));
-			*props = BeachProperties.new();
-			curr->properties = props;
+			if (was_full)
+			{
+				was_full[c] = TRUE;
+			}
+			AddHorizonCell(this, r, c);
 		}
+	}
+}
 
-		// backtrack
-		dir_r = -dir_r;
-		dir_c = -dir_c;
-		int currRow = curr->GetRow(curr);
-		int currCol = curr->GetCol(curr);
-		int backtrack[2] = { currRow + dir_r, currCol + dir_c };
-		int temp[2] = { backtrack[0], backtrack[1] };
-		struct BeachNode* tempNode = NULL;
-		do
-		{
-			// turn 45 degrees clockwise to next neighbor
-			double angle = atan2(temp[0] - currRow, temp[1] - currCol);
-			angle += (PI / 4);
-			int next[2] = { currRow + round(sin(angle)), currCol + round(cos(angle)) };
+// scan rows up to max_row from scratch
+static void BuildHorizon(struct BeachGrid* this, int max_row)
+{
+	struct ShadowCache* cache = &this->shadow_cache;
+	int i;
+	for (i = 0; i < this->horizon.num_buckets; i++)
+	{
+		this->horizon.furthest[i] = -HUGE_VAL;
+	}
 
-			// break if running off edge of grid
-			if (next[0] < 0 || next[0] >= this->rows || next[1] < 0 || next[1] >= this->cols)
+	int r;
+	for (r = 0; r <= max_row; r++)
+	{
+		ScanHorizonRow(this, r);
+	}
+	if (cache->is_active)
+	{
+		cache->scanned_rows = max_row + 1;
+	}
+}
+
+// rebuild one bucket from the cells of its band
+static void RebuildHorizonBucket(struct BeachGrid* this, int b, int max_row)
+{
+	struct ShadowHorizon* horizon = &this->horizon;
+	double W = this->cell_width;
+	double L = this->cell_length;
+	horizon->furthest[b] = -HUGE_VAL;
+
+	int r, c;
+	for (r = 0; r <= max_row; r++)
+	{
+		// columns whose across falls in the bucket, padded for rounding
+		int c_lo = this->profile.first[r], c_hi = this->profile.last[r];
+		if (b > 0 && b < horizon->num_buckets - 1 && fabs(horizon->dy) > HORIZON_EPSILON)
+		{
+			double c1 = (horizon->origin + b * horizon->width + r * L * horizon->dx) / (W * horizon->dy);
+			double c2 = (horizon->origin + (b + 1) * horizon->width + r * L * horizon->dx) / (W * horizon->dy);
+			int lo = (int)floor(c1 < c2 ? c1 : c2) - 1;
+			int hi = (int)ceil(c1 < c2 ? c2 : c1) + 1;
+			c_lo = lo > c_lo ? lo : c_lo;
+			c_hi = hi < c_hi ? hi : c_hi;
+		}
+		for (c = c_lo; c <= c_hi; c++)
+		{
+			if (this->frac_full[r][c] == 1 && GetHorizonBucket(this, GetAcross(this, r, c)) == b)
 			{
-				break;
+				AddHorizonCell(this, r, c);
 			}
+		}
+	}
+}
 
-			// track dir relative to previous neighbor for backtracking
-			dir_r = next[0] - temp[0];
-			dir_c = next[1] - temp[1];
-			temp[0] = next[0];
-			temp[1] = next[1];
-			tempNode = (*this).TryGetNode(this, temp[0], temp[1]);
-			if (tempNode)
-			{
-				if (tempNode->frac_full != 0 && !tempNode->properties)
+// compare one cell with its flag from the last scan
+static void UpdateHorizonCell(struct BeachGrid* this, int r, int c)
+{
+	struct ShadowHorizon* horizon = &this->horizon;
+	struct ShadowCache* cache = &this->shadow_cache;
+	unsigned char* was_full = &cache->was_full[(size_t)r * this->cols + c];
+	int is_full = this->frac_full[r][c] == 1;
+	if (*was_full == is_full)
+	{
+		return;
+	}
+	*was_full = is_full;
+	int b = GetHorizonBucket(this, GetAcross(this, r, c));
+	cache->changed_at[b] = cache->stamp;
+	if (is_full)
+	{
+		AddHorizonCell(this, r, c);
+	}
+	else if (c * this->cell_width * horizon->dx + r * this->cell_length * horizon->dy >= horizon->furthest[b])
+	{
+		// mark for rebuild, meanwhile bound nothing
+		horizon->furthest[b] = HUGE_VAL;
+	}
+}
+
+/**
+* Bring the horizon up to date with the cells that changed since the last
+* scan: stamp their buckets for the cache, add new full cells and rebuild
+* buckets whose furthest full cell may have gone
+*/
+static void UpdateHorizon(struct BeachGrid* this, int max_row)
+{
+	struct ShadowHorizon* horizon = &this->horizon;
+	struct ShadowCache* cache = &this->shadow_cache;
+
+	// cells scanned before can only have changed where nodes were
+	int r, c;
+	for (c = 0; c < this->cols; c++)
+	{
+		int top = this->profile.dirty_top[c] > 0 ? this->profile.dirty_top[c] : 0;
+		int bottom = this->profile.dirty_bottom[c] < cache->scanned_rows ? this->profile.dirty_bottom[c] : cache->scanned_rows - 1;
+		for (r = top; r <= bottom; r++)
+		{
+			UpdateHorizonCell(this, r, c);
+		}
+	}
+	// rows not scanned before were never relied on
+	for (r = cache->scanned_rows; r <= max_row; r++)
+	{
+		ScanHorizonRow(this, r);
+	}
+	if (max_row + 1 > cache->scanned_rows)
+	{
+		cache->scanned_rows = max_row + 1;
+	}
+
+	int b;
+	for (b = 0; b < horizon->num_buckets; b++)
+	{
+		if (horizon->furthest[b] == HUGE_VAL)
+		{
+			RebuildHorizonBucket(this, b, cache->scanned_rows - 1);
+		}
+	}
+}
+
+/**
+* Build the shadow horizon for waves from wave_angle out of the full cells
+* the shoreline's rays can reach (rows up to the deepest shoreline node).
+* When the angle repeats the previous build, the horizon is updated from the
+* cells that changed instead, which also tells the shadow cache which
+* buckets to invalidate. The land profile is brought up to date first.
+* Valid until the raster changes; clear it then.
+*/
+static void SetShadowHorizon(struct BeachGrid* this, double wave_angle)
+{
+	struct ShadowHorizon* horizon = &this->horizon;
+	struct ShadowCache* cache = &this->shadow_cache;
+	horizon->is_set = FALSE;
+	UpdateLandProfile(this);
+
+	double cos_angle = cos(wave_angle);
+	double sin_angle = sin(wave_angle);
+	if (cos_angle < 0 || !this->shoreline)
+	{
+		// rays heading landward are not bounded by the rows above them
+		cache->is_active = FALSE;
+		horizon->wave_angle = EMPTY_double;
+		ResetLandDirty(this);
+		return;
+	}
+
+	int max_row = -1;
+	struct BeachNode* curr;
+	for (curr = this->shoreline; !curr->is_boundary; curr = curr->next)
+	{
+		max_row = curr->row > max_row ? curr->row : max_row;
+	}
+
+	// ray direction as in CastShadowRay, in distance across the grid
+	double W = this->cell_width;
+	double L = this->cell_length;
+	horizon->dx = (sin_angle >= 0 ? -1 : 1) * fabs(sin_angle);
+	horizon->dy = -fabs(cos_angle);
+	// a visited cell's corner sits within one cell of the ray point behind it
+	horizon->width = W * fabs(horizon->dy) + L * fabs(horizon->dx);
+	horizon->reach = W * fabs(horizon->dx) + L * fabs(horizon->dy);
+
+	// lay buckets over the whole grid so they only depend on the angle
+	double corners[4] = { 0.0, this->cols * W * horizon->dy, -this->rows * L * horizon->dx,
+		this->cols * W * horizon->dy - this->rows * L * horizon->dx };
+	double lo = corners[0], hi = corners[0];
+	int i;
+	for (i = 1; i < 4; i++)
+	{
+		lo = corners[i] < lo ? corners[i] : lo;
+		hi = corners[i] > hi ? corners[i] : hi;
+	}
+	horizon->origin = lo;
+	horizon->num_buckets = (int)((hi - lo) / horizon->width) + 1;
+	if (horizon->num_buckets > horizon->capacity)
+	{
+		free(horizon->furthest);
+		horizon->furthest = malloc(horizon->num_buckets * sizeof(double));
+		horizon->capacity = horizon->num_buckets;
+	}
+
+	if (wave_angle != horizon->wave_angle)
+	{
+		cache->is_active = FALSE;
+	}
+	else if (!cache->is_active)
+	{
+		StartShadowCache(this);
+	}
+	cache->stamp++;
+
+	if (cache->is_active && cache->scanned_rows > 0)
+	{
+		UpdateHorizon(this, max_row);
+	}
+	else
+	{
+		BuildHorizon(this, max_row);
+	}
+
+	// the nodes of this trace are the first to move sediment
+	ResetLandDirty(this);
+
+	horizon->wave_angle = wave_angle;
+	horizon->max_row = max_row;
+	horizon->is_set = TRUE;
+}
+
+static void ClearShadowHorizon(struct BeachGrid* this)
+{
+	this->horizon.is_set = FALSE;
+}
+
+static int CheckIfInShadow(struct BeachGrid* this, struct BeachNode* node, double wave_angle)
+{
+	if (node->is_boundary)
+	{
+		return FALSE;
+	}
+
+	if (node->properties->shadow_timestamp == this->current_time)
+	{
+		return node->properties->in_shadow;
+	}
+
+	node->properties->shadow_timestamp = this->current_time;
+	node->properties->in_shadow = CheckIfCellInShadow(this, node->row, node->col, *node->frac_full, wave_angle);
+	return node->properties->in_shadow;
+}
+
+/* ---- SHORELINE TRACE ----
+ * Moore tracing of the cells holding sand, from the first one down the
+ * columns from the top left. A step scans the 8 neighbors of the current
+ * cell, 45 degrees clockwise at a time from its backtrack cell, for the
+ * first cell holding sand that is not traced yet; the cell scanned just
+ * before it is the next backtrack. Running into the edge of the grid ends
+ * the trace.
+ */
+#define ORDER_SPACING 1024
+
+/* Moore neighbors by direction, each 45 degrees clockwise of the one before */
+static const int MOORE_ROWS[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+static const int MOORE_COLS[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+
+// direction of the neighbor at d_row, d_col, -1 if it is not one
+static int GetMooreDirection(int d_row, int d_col)
+{
+	int k;
+	for (k = 0; k < 8; k++)
+	{
+		if (MOORE_ROWS[k] == d_row && MOORE_COLS[k] == d_col)
+		{
+			return k;
+		}
+	}
+	return -1;
+}
+
+/**
+* One step of the trace from row, col with its backtrack cell in direction
+* back. The cell of a node counts as traced if the node is stamped with
+* stamp or comes no later than traced_order along the chain.
+* RETURN: TRUE with row, col and back moved to the next cell, FALSE if the trace ends
+*/
+static int FindNextCell(struct BeachGrid* this, int* row, int* col, int* back, int stamp, int traced_order)
+{
+	int i;
+	for (i = 1; i <= 8; i++)
+	{
+		int k = (*back + i) % 8;
+		int r = *row + MOORE_ROWS[k];
+		int c = *col + MOORE_COLS[k];
+		if (r < 0 || r >= this->rows || c < 0 || c >= this->cols)
+		{
+			return FALSE;
+		}
+		if (this->frac_full[r][c] == 0)
+		{
+			continue;
+		}
+		struct BeachNode* node = TryGetNode(this, r, c);
+		if (node && (node->trace_stamp == stamp || node->order <= traced_order))
+		{
+			continue;
+		}
+		int scanned = (k + 7) % 8;
+		*back = GetMooreDirection(*row + MOORE_ROWS[scanned] - r, *col + MOORE_COLS[scanned] - c);
+		*row = r;
+		*col = c;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+// boundary node past an end cell of the trace, NULL if the cell is not on the edge of the grid
+static struct BeachNode* NewBoundary(struct BeachGrid* this, struct BeachNode* node)
+{
+	if (node->col == 0) { return BeachNode.boundary(&this->node_pool, EMPTY_INT, -1); }
+	else if (node->col == this->cols - 1) { return BeachNode.boundary(&this->node_pool, EMPTY_INT, this->cols); }
+	else if (node->row == 0) { return BeachNode.boundary(&this->node_pool, -1, EMPTY_INT); }
+	else if (node->row == this->rows - 1) { return BeachNode.boundary(&this->node_pool, this->rows, EMPTY_INT); }
+	return NULL;
+}
+
+// number the chain from 0 at its start boundary, ORDER_SPACING apart; a chain built by hand needs it before RepairShoreline
+static void OrderShoreline(struct BeachGrid* this)
+{
+	struct BeachNode* curr = this->shoreline;
+	if (!curr)
+	{
+		return;
+	}
+	int length = this->num_nodes + 2;
+	int spacing = length < INT_MAX / ORDER_SPACING ? ORDER_SPACING : INT_MAX / length;
+	int order = 0;
+	curr->prev->order = order;
+	while (TRUE)
+	{
+		order += spacing;
+		curr->order = order;
+		if (curr->is_boundary)
+		{
+			break;
+		}
+		curr = curr->next;
+	}
+}
+
+int FindBeach(struct BeachGrid* this)
+{
+	// clear current shoreline if grid already has one
+	if (this->shoreline != NULL)
+	{
+		(*this).FreeShoreline(this);
+	}
+	this->repair.num_crossed = 0;
+	this->repair.is_incomplete = FALSE;
+	
+	// start search downward from top left
+	int r, c;
+	for (c = 0; c < this->cols; c++) {
+		for (r = 1; r < this->rows; r++) {
+			double* cell = (*this).TryGetCell(this, r, c);
+			if (!cell) { return -1; }
+
+			// start tracing shoreline
+			if (*cell != 0) {
+				struct BeachNode* startNode = (*this).AddNode(this, r, c);
+
+				struct BeachNode* endNode = (*this).GetShoreline(this, startNode, 1, 0);
+				if (!endNode)
+				{
+					return -1;
+				}
+
+				// set boundaries, a trace not starting and ending on the grid boundary is an invalid grid
+				struct BeachNode* startBoundary = NewBoundary(this, startNode);
+				if (!startBoundary)
 				{
-					break;
+					return -1;
 				}
-				else if (stopNode)
+				startNode->prev = startBoundary;
+				startBoundary->next = startNode;
+
+				struct BeachNode* endBoundary = NewBoundary(this, endNode);
+				if (!endBoundary)
 				{
-					// break if we reach stopNode or past stopNode
-					if (tempNode == stopNode || tempNode == stopNode->next || (stopNode->next && tempNode == stopNode->next->next))
-					{
-						curr->next = tempNode;
-						tempNode->prev = curr;
-						return tempNode;
-					}
+					return -1;
 				}
-				tempNode = NULL;
+				endNode->next = endBoundary;
+				endBoundary->prev = endNode;
+
+				(*this).SetShoreline(this, startNode);
+				OrderShoreline(this);
+				return 0;
 			}
-		} while (temp[0] != backtrack[0] || temp[1] != backtrack[1]);
+		}
+	}
+	return -1;
+}
+
+/* ---- SHORELINE REPAIR ----
+ * A step of the trace depends on the cells around the step's node and on
+ * which of them were traced before. The steps that scan a cell moved
+ * across 0 are re-traced, and the stretch is spliced back in where it steps
+ * onto the old chain as the old chain did, so the repaired shoreline is
+ * the one FindBeach would trace.
+ */
 
-		// end trace
-		if (tempNode == NULL)
+/**
+* Append row, col to a list of cells
+* RETURN: 0 on success, -1 if the list could not grow, left as it was
+*/
+static int PushCell(int** cells, int* count, int* capacity, int row, int col)
+{
+	if (*count == *capacity)
+	{
+		int new_capacity = *capacity > 0 ? 2 * *capacity : 64;
+		int* new_cells = realloc(*cells, 2 * new_capacity * sizeof(int));
+		if (!new_cells)
 		{
+			return -1;
+		}
+		*cells = new_cells;
+		*capacity = new_capacity;
+	}
+	(*cells)[2 * *count] = row;
+	(*cells)[2 * *count + 1] = col;
+	(*count)++;
+	return 0;
+}
+
+/**
+* Note a cell moved across 0, for the next RepairShoreline
+* RETURN: 0 on success, -1 if it could not be kept, the next repair then traces the whole shoreline
+*/
+static int MarkCrossing(struct BeachGrid* this, int row, int col)
+{
+	struct ShorelineRepair* repair = &this->repair;
+	if (PushCell(&repair->crossed, &repair->num_crossed, &repair->crossed_capacity, row, col) != 0)
+	{
+		repair->is_incomplete = TRUE;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+* Queue the nodes whose step scans the cell at row, col
+* RETURN: 0 on success, -1 if the queue could not grow
+*/
+static int QueueNodesAround(struct BeachGrid* this, int row, int col)
+{
+	struct ShorelineRepair* repair = &this->repair;
+	int r, c;
+	for (r = row - 1; r <= row + 1; r++)
+	{
+		for (c = col - 1; c <= col + 1; c++)
+		{
+			struct BeachNode* node = TryGetNode(this, r, c);
+			if (node && PushCell(&repair->pending, &repair->num_pending, &repair->pending_capacity, r, c) != 0)
+			{
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+// first queued node past order after along the chain, dropping the entries up to it
+static struct BeachNode* NextPending(struct BeachGrid* this, int after)
+{
+	struct ShorelineRepair* repair = &this->repair;
+	struct BeachNode* first = NULL;
+	int i, kept = 0;
+	for (i = 0; i < repair->num_pending; i++)
+	{
+		int row = repair->pending[2 * i];
+		int col = repair->pending[2 * i + 1];
+		struct BeachNode* node = TryGetNode(this, row, col);
+		if (!node || node->order <= after)
+		{
+			continue;
+		}
+		repair->pending[2 * kept] = row;
+		repair->pending[2 * kept + 1] = col;
+		kept++;
+		if (!first || node->order < first->order)
+		{
+			first = node;
+		}
+	}
+	repair->num_pending = kept;
+	return first;
+}
+
+static int IsPending(struct BeachGrid* this, struct BeachNode* node)
+{
+	struct ShorelineRepair* repair = &this->repair;
+	int i;
+	for (i = 0; i < repair->num_pending; i++)
+	{
+		if (repair->pending[2 * i] == node->row && repair->pending[2 * i + 1] == node->col)
+		{
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+// RETURN: 0 on success, -1 if the stretch could not grow
+static int AddToStretch(struct BeachGrid* this, int index, struct BeachNode* node)
+{
+	struct ShorelineRepair* repair = &this->repair;
+	if (index >= repair->stretch_capacity)
+	{
+		int capacity = repair->stretch_capacity > 0 ? 2 * repair->stretch_capacity : 64;
+		struct BeachNode** stretch = realloc(repair->stretch, capacity * sizeof(struct BeachNode*));
+		if (!stretch)
+		{
+			return -1;
+		}
+		repair->stretch = stretch;
+		repair->stretch_capacity = capacity;
+	}
+	repair->stretch[index] = node;
+	node->trace_stamp = repair->stamp;
+	return 0;
+}
+
+/**
+* Re-trace the chain from first, whose own step in is unchanged, until the
+* trace steps onto an old node the way the old chain did, past the old
+* nodes it took and with no change around it, or else to the end of the
+* trace. Old nodes the stretch passed over leave the chain, and the nodes
+* further on that scan a cell which joined or left the chain are queued.
+* RETURN: order of the stretch's last node, -1 if the trace ends off the edge of the grid
+*   or the repair's lists could not grow, leaving the chain for FindBeach to replace
+*/
+static int RetraceStretch(struct BeachGrid* this, struct BeachNode* first)
+{
+	struct ShorelineRepair* repair = &this->repair;
+	struct BeachNode* before = first->prev;
+	int row = first->row;
+	int col = first->col;
+	int back = GetMooreDirection(-1, 0);   // as FindBeach starts
+	if (!before->is_boundary)
+	{
+		int k = GetMooreDirection(row - before->row, col - before->col);
+		if (k < 0)
+		{
+			return -1;
+		}
+		int scanned = (k + 7) % 8;
+		back = GetMooreDirection(before->row + MOORE_ROWS[scanned] - row, before->col + MOORE_COLS[scanned] - col);
+	}
+
+	repair->stamp++;
+	repair->num_moved = 0;
+	int n = 0;
+	int last_taken = first->order;
+	if (AddToStretch(this, n++, first) != 0)
+	{
+		return -1;
+	}
+	struct BeachNode* join = NULL;
+	while (FindNextCell(this, &row, &col, &back, repair->stamp, first->order))
+	{
+		struct BeachNode* node = TryGetNode(this, row, col);
+		if (node && node->prev == repair->stretch[n - 1] && node->order > last_taken && !IsPending(this, node))
+		{
+			join = node;
 			break;
 		}
+		if (node)
+		{
+			last_taken = node->order > last_taken ? node->order : last_taken;
+		}
+		else
+		{
+			node = (*this).AddNode(this, row, col);
+			if (!node || PushCell(&repair->moved, &repair->num_moved, &repair->moved_capacity, row, col) != 0)
+			{
+				return -1;
+			}
+		}
+		if (AddToStretch(this, n++, node) != 0)
+		{
+			return -1;
+		}
+	}
+
+	// drop the old nodes passed over, up to the join or the end boundary
+	struct BeachNode* curr = first->next;
+	while (curr != join && !curr->is_boundary)
+	{
+		struct BeachNode* next = curr->next;
+		if (curr->trace_stamp != repair->stamp)
+		{
+			if (PushCell(&repair->moved, &repair->num_moved, &repair->moved_capacity, curr->row, curr->col) != 0)
+			{
+				return -1;
+			}
+			(*this).RemoveNode(this, curr);
+		}
+		curr = next;
+	}
+	struct BeachNode* last = repair->stretch[n - 1];
+	struct BeachNode* end = join;
+	if (!join)
+	{
+		BeachNode.free(&this->node_pool, curr);
+		end = NewBoundary(this, last);
+		if (!end)
+		{
+			return -1;
+		}
+	}
+
+	int i;
+	for (i = 1; i < n; i++)
+	{
+		repair->stretch[i - 1]->next = repair->stretch[i];
+		repair->stretch[i]->prev = repair->stretch[i - 1];
+	}
+	last->next = end;
+	end->prev = last;
+	(*this).SetShoreline(this, this->shoreline);
+
+	// number the stretch in the gap it fills, renumbering the chain if it doesn't fit
+	long long lower = before->order;
+	long long upper = join ? join->order : lower + (long long)(n + 1) * ORDER_SPACING;
+	long long spacing = (upper - lower) / (n + 1);
+	if (spacing < 1 || upper > INT_MAX)
+	{
+		OrderShoreline(this);
+	}
+	else
+	{
+		for (i = 0; i < n; i++)
+		{
+			repair->stretch[i]->order = (int)(lower + (i + 1) * spacing);
+		}
+		end->order = (int)upper;
+	}
+
+	for (i = 0; i < repair->num_moved; i++)
+	{
+		if (QueueNodesAround(this, repair->moved[2 * i], repair->moved[2 * i + 1]) != 0)
+		{
+			return -1;
+		}
+	}
+	return last->order;
+}
 
-		curr->next = tempNode;
-		tempNode->prev = curr;
-		curr = tempNode;
+/**
+* Bring the shoreline up to date with the cells marked by MarkCrossing,
+* re-tracing only the stretches whose steps scan one of them. A crossing
+* that could move the start of the trace falls back to FindBeach, as does
+* a stretch ending off the edge of the grid, a crossing that could not be
+* kept, and running out of memory for the re-trace.
+* RETURN: 0 on success, -1 if the grid has no valid shoreline
+*/
+static int RepairShoreline(struct BeachGrid* this)
+{
+	struct ShorelineRepair* repair = &this->repair;
+	if (repair->num_crossed == 0 && !repair->is_incomplete)
+	{
+		return 0;
+	}
+	struct BeachNode* head = this->shoreline;
+	if (!head || head->is_boundary || head->order <= head->prev->order || repair->is_incomplete)
+	{
+		// no chain to repair, one never numbered, or crossings lost
+		return FindBeach(this);
+	}
+
+	repair->num_pending = 0;
+	int i;
+	for (i = 0; i < repair->num_crossed; i++)
+	{
+		int row = repair->crossed[2 * i];
+		int col = repair->crossed[2 * i + 1];
+		if (col < head->col || (col == head->col && row <= head->row))
+		{
+			return FindBeach(this);
+		}
+		if (QueueNodesAround(this, row, col) != 0)
+		{
+			return FindBeach(this);
+		}
+	}
+	repair->num_crossed = 0;
+
+	int after = head->prev->order;
+	struct BeachNode* first;
+	while ((first = NextPending(this, after)) != NULL)
+	{
+		after = RetraceStretch(this, first);
+		if (after < 0)
+		{
+			return FindBeach(this);
+		}
+	}
+	return 0;
+}
+
+/**
+* Trace the shoreline on from startNode, its backtrack cell opposite dir_r, dir_c
+* RETURN: last node of the trace
+*/
+struct BeachNode* GetShoreline(struct BeachGrid* this, struct BeachNode* startNode, int dir_r, int dir_c)
+{
+	int back = GetMooreDirection(-dir_r, -dir_c);
+	if (!startNode || back < 0)
+	{
+		return NULL;
+	}
+	struct BeachNode* curr = startNode;
+	int row = curr->row;
+	int col = curr->col;
+	while (FindNextCell(this, &row, &col, &back, EMPTY_INT, INT_MAX))
+	{
+		struct BeachNode* next = (*this).AddNode(this, row, col);
+		curr->next = next;
+		next->prev = curr;
+		curr = next;
 	}
 	return curr;
 }
 
-static double GetDistance(struct Beachgrid* this, struct BeachNode* node1, struct BeachNode* node2)
+static double GetDistance(struct BeachGrid* this, struct BeachNode* node1, struct BeachNode* node2)
 {
-	return sqrt(pow(node1->GetRow(node1) - node2->GetRow(node2), 2) + pow(node1->GetCol(node1) - node2->GetCol(node2), 2));
+	return sqrt(pow(BeachNode.GetRow(node1, this) - BeachNode.GetRow(node2, this), 2) + pow(BeachNode.GetCol(node1, this) - BeachNode.GetCol(node2, this), 2));
 }
 
 
 static struct BeachGrid new(int rows, int cols, double cell_width, double cell_length){
-	g_cell_width = cell_width;
-	g_cell_length = cell_length;
-
 	return (struct BeachGrid) {
 			.rows = rows,
 			.cols = cols,
+			.cell_width = cell_width,
+			.cell_length = cell_length,
 			.current_time = 0,
-			.cells = NULL,
+			.frac_full = AllocateRaster(rows, cols),
+			.nodes = NULL,
+			.nodes_capacity = 0,
+			.num_nodes = 0,
+			.node_pool = NodePool.new(),
+			.horizon = { .is_set = FALSE, .wave_angle = EMPTY_double, .furthest = NULL, .num_buckets = 0, .capacity = 0 },
+			.shadow_cache = { .is_active = FALSE, .entries = NULL, .capacity = 0, .count = 0,
+				.changed_at = NULL, .buckets_capacity = 0, .was_full = NULL },
+			.profile = { .is_built = FALSE, .top = NULL, .first = NULL, .last = NULL,
+				.dirty_top = NULL, .dirty_bottom = NULL },
+			.changes = { .is_tracking = FALSE, .stamp = 0, .top = NULL, .bottom = NULL },
+			.segments = { .rise = NULL, .run = NULL, .capacity = 0 },
+			.transport_cache = { .is_active = FALSE, .step = 0, .tolerance = 0, .wave_angle = EMPTY_double,
+				.timestep_length = EMPTY_double, .entries = NULL, .chain = NULL, .moved = NULL, .capacity = 0 },
+			.repair = { .crossed = NULL, .num_crossed = 0, .crossed_capacity = 0, .is_incomplete = FALSE, .pending = NULL, .num_pending = 0,
+				.pending_capacity = 0, .moved = NULL, .num_moved = 0, .moved_capacity = 0, .stretch = NULL,
+				.stretch_capacity = 0, .stamp = 0 },
 			.shoreline = NULL,
-			.SetCells = &SetCells,
+			.shoreline_version = 0,
 			.SetShoreline = &SetShoreline,
 			.FreeShoreline = &FreeShoreline,
+			.TryGetCell = &TryGetCell,
 			.TryGetNode = &TryGetNode,
+			.AddNode = &AddNode,
+			.RemoveNode = &RemoveNode,
+			.SetShorelineAngles = &SetShorelineAngles,
 			.GetPrevAngle = &GetPrevAngle,
 			.GetNextAngle = &GetNextAngle,
 			.GetSurroundingAngle = &GetSurroundingAngle,
 			.GetAngleByDifferencingScheme = &GetAngleByDifferencingScheme,
-			.ReplaceNode = &ReplaceNode,
 			.Get4Neighbors = &Get4Neighbors,
 			.CheckIfInShadow = &CheckIfInShadow,
+			.CheckIfCellInShadow = &CheckIfCellInShadow,
+			.FindCellShadow = &FindCellShadow,
+			.KeepCellShadow = &KeepCellShadow,
+			.SetShadowHorizon = &SetShadowHorizon,
+			.ClearShadowHorizon = &ClearShadowHorizon,
+			.TrackChanges = &TrackChanges,
 			.FindBeach = &FindBeach,
+			.MarkCrossing = &MarkCrossing,
+			.RepairShoreline = &RepairShoreline,
+			.OrderShoreline = &OrderShoreline,
 			.GetShoreline = &GetShoreline,
 			.GetDistance = &GetDistance
 			};
 }
 
-const struct BeachGridClass BeachGrid = { .new = &new };
+static void FreeBeachGrid(struct BeachGrid* this)
+{
+	(*this).FreeShoreline(this);
+	NodePool.free(&this->node_pool);
+	free(this->horizon.furthest);
+	this->horizon.furthest = NULL;
+	this->horizon.capacity = 0;
+	this->horizon.is_set = FALSE;
+	free(this->shadow_cache.entries);
+	free(this->shadow_cache.changed_at);
+	free(this->shadow_cache.was_full);
+	this->shadow_cache = (struct ShadowCache) { .is_active = FALSE };
+	free(this->profile.top);
+	free(this->profile.first);
+	free(this->profile.last);
+	free(this->profile.dirty_top);
+	free(this->profile.dirty_bottom);
+	this->profile = (struct LandProfile) { .is_built = FALSE };
+	free(this->changes.top);
+	free(this->changes.bottom);
+	this->changes = (struct ChangeTracker) { .is_tracking = FALSE };
+	free(this->segments.rise);
+	free(this->segments.run);
+	this->segments = (struct SegmentBuffer) { .capacity = 0 };
+	free(this->transport_cache.entries);
+	free(this->transport_cache.chain);
+	free(this->transport_cache.moved);
+	this->transport_cache = (struct TransportCache) { .is_active = FALSE };
+	free(this->repair.crossed);
+	free(this->repair.pending);
+	free(this->repair.moved);
+	free(this->repair.stretch);
+	this->repair = (struct ShorelineRepair) { .num_crossed = 0 };
+	free(this->nodes);
+	this->nodes = NULL;
+	this->nodes_capacity = 0;
+	if (this->frac_full)
+	{
+		FreeRaster(this->frac_full);
+		this->frac_full = NULL;
+	}
+}
+
+const struct BeachGridClass BeachGrid = { .new = &new, .free = &FreeBeachGrid };
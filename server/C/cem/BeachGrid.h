@@ -7,29 +7,157 @@ extern "C" {
 
 #include "BeachNode.h"
 
-double g_cell_length, g_cell_width;
+/**
+ * Full cells seen by shadow rays for one wave angle, in wave-aligned
+ * coordinates: bucketed by offset across the rays, each bucket keeping
+ * the distance along the rays of its furthest full cell.
+ */
+struct ShadowHorizon {
+    int is_set;
+    double wave_angle;
+    double dx, dy;                /* unit ray direction in grid distance */
+    double origin, width;         /* across-ray offset of bucket 0, bucket width */
+    double reach;                 /* how far a visited cell can lead its ray point */
+    double *furthest;             /* per bucket, -HUGE_VAL if no full cell */
+    int num_buckets, capacity, max_row;
+};
+
+struct ShadowEntry {
+    int key;                      /* row * cols + col, EMPTY_INT if unused */
+    int stamp;                    /* cache stamp the threshold was computed at */
+    double threshold;             /* frac_full below which the cell is shaded */
+};
+
+/**
+ * Shadow thresholds of cells kept while the wave angle repeats, see
+ * CheckIfCellInShadow. Buckets are the horizon's.
+ */
+struct ShadowCache {
+    int is_active, stamp;
+    struct ShadowEntry *entries;  /* open addressing by cell */
+    int capacity, count;
+    int *changed_at;              /* per bucket, stamp a full cell in it last changed at */
+    int buckets_capacity;
+    unsigned char *was_full;      /* rows x cols full flags at the last scan */
+    int scanned_rows;             /* rows of was_full that have been scanned */
+};
+
+/**
+ * Where the full cells are, kept up to date from the cells around nodes
+ * (sediment only moves through those) each time the shadow horizon is set.
+ */
+struct LandProfile {
+    int is_built;
+    int *top;                     /* per column, most seaward full row, rows if none */
+    int *first, *last;            /* per row, outermost full columns, cols and -1 if none */
+    int *dirty_top, *dirty_bottom; /* per column, rows that may have changed since the last update */
+};
+
+/**
+ * Rows each column may have changed in since TrackChanges, from the cells
+ * around every node since then, for checkpoint journals. Each restart
+ * takes a new stamp, so a user holding an older one knows it lost track.
+ */
+struct ChangeTracker {
+    int is_tracking, stamp;
+    int *top, *bottom;            /* per column, empty when top > bottom */
+};
+
+/* Rise and run of each shoreline segment, scratch of SetShorelineAngles */
+struct SegmentBuffer {
+    double *rise, *run;
+    int capacity;
+};
+
+/* A shoreline cell's inputs and results at its last transport potential, see WaveTransformation */
+struct TransportEntry {
+    double frac_full;             /* frac_full the nodes depending on the cell were computed with */
+    double transport_potential;
+    int prev, next;               /* cells of the chain neighbors, -1 for a boundary */
+    int visited;                  /* cache step the cell was last on the shoreline at */
+    int in_shadow;
+    FLOW_DIR transport_dir;
+};
+
+/**
+ * Transport potentials kept per cell while the wave repeats, so a step only
+ * recomputes the nodes whose neighborhood moved by more than tolerance.
+ */
+struct TransportCache {
+    int is_active, step;
+    double tolerance;             /* frac_full change a cell may drift by before it counts as moved */
+    double wave_angle, wave_height, wave_period;
+    double timestep_length;       /* potentials scale with it, so a new length is a new wave */
+    struct TransportEntry *entries; /* rows x cols, allocated on first use */
+    struct BeachNode **chain;     /* scratch: shoreline nodes in order */
+    unsigned char *moved;         /* scratch: per chain position */
+    int capacity;
+};
+
+/**
+ * Cells moved across 0 since the shoreline was last traced (the trace
+ * follows the cells holding sand, so only those can change it), and
+ * scratch of the local re-trace in RepairShoreline. Cells are kept as
+ * row, col pairs.
+ */
+struct ShorelineRepair {
+    int *crossed;                 /* cells moved across 0 */
+    int num_crossed, crossed_capacity;
+    int is_incomplete;            /* a crossing could not be kept, the next repair traces it all */
+    int *pending;                 /* cells of nodes whose trace step may have changed */
+    int num_pending, pending_capacity;
+    int *moved;                   /* cells that joined or left the chain in the last stretch */
+    int num_moved, moved_capacity;
+    struct BeachNode **stretch;   /* nodes of the stretch being re-traced, in order */
+    int stretch_capacity;
+    int stamp;                    /* marks the nodes traced into the current stretch */
+};
 
 struct BeachGrid {
     int rows, cols, current_time;
-    struct BeachNode **cells;
+    int shoreline_version;  /* bumped whenever the next/prev chain is relinked */
+    double cell_width, cell_length;
+    double **frac_full;           /* rows x cols raster inside a one-cell halo: [-1..rows][-1..cols] */
+    struct BeachNode **nodes;     /* shoreline nodes by cell, hash table */
+    int nodes_capacity, num_nodes;
+    struct NodePool node_pool;    /* backs every node, reset on re-trace */
+    struct ShadowHorizon horizon;
+    struct ShadowCache shadow_cache;
+    struct LandProfile profile;
+    struct ChangeTracker changes;
+    struct SegmentBuffer segments;
+    struct TransportCache transport_cache;
+    struct ShorelineRepair repair;
     struct BeachNode *shoreline;
-    struct BeachGrid* (*SetCells)(struct BeachGrid *this, struct BeachNode **cells);
     struct BeachNode* (*SetShoreline)(struct BeachGrid *this, struct BeachNode *shoreline);
 		void (*FreeShoreline)(struct BeachGrid* this);
+    double* (*TryGetCell)(struct BeachGrid *this, int row, int col);
     struct BeachNode* (*TryGetNode)(struct BeachGrid *this, int row, int col);
+    struct BeachNode* (*AddNode)(struct BeachGrid *this, int row, int col);
+    void (*RemoveNode)(struct BeachGrid *this, struct BeachNode *node);
+    void (*SetShorelineAngles)(struct BeachGrid *this);
     double (*GetPrevAngle)(struct BeachGrid *this, struct BeachNode *node);
     double (*GetNextAngle)(struct BeachGrid *this, struct BeachNode *node);
     double (*GetSurroundingAngle)(struct BeachGrid *this, struct BeachNode *node);
     double (*GetAngleByDifferencingScheme)(struct BeachGrid *this, struct BeachNode *node, double wave_angle);
-		struct BeachNode* (*ReplaceNode)(struct BeachGrid *this, struct BeachNode* node);
-    struct BeachNode** (*Get4Neighbors)(struct BeachGrid *this, struct BeachNode *node);
+    void (*Get4Neighbors)(struct BeachGrid *this, struct BeachNode *node, double *neighbors[4]);
     int (*CheckIfInShadow)(struct BeachGrid *this, struct BeachNode *node, double wave_angle);
+    int (*CheckIfCellInShadow)(struct BeachGrid *this, int row, int col, double frac_full, double wave_angle);
+    int (*FindCellShadow)(struct BeachGrid *this, int row, int col, double frac_full, double wave_angle, struct ShadowEntry *kept);
+    void (*KeepCellShadow)(struct BeachGrid *this, const struct ShadowEntry *kept);
+    void (*SetShadowHorizon)(struct BeachGrid *this, double wave_angle);
+    void (*ClearShadowHorizon)(struct BeachGrid *this);
+    int (*TrackChanges)(struct BeachGrid *this);
 		int (*FindBeach)(struct BeachGrid* this);
-		struct BeachNode* (*GetShoreline)(struct BeachGrid *this, struct BeachNode *startNode, struct BeachNode* stopNode, int dir_r, int dir_c);
+		int (*MarkCrossing)(struct BeachGrid* this, int row, int col);
+		int (*RepairShoreline)(struct BeachGrid* this);
+		void (*OrderShoreline)(struct BeachGrid* this);
+		struct BeachNode* (*GetShoreline)(struct BeachGrid *this, struct BeachNode *startNode, int dir_r, int dir_c);
 		double (*GetDistance)(struct BeachGrid* this, struct BeachNode* node1, struct BeachNode* node2);
 };
 extern const struct BeachGridClass {
     struct BeachGrid (*new)(int rows, int cols, double cell_width, double cell_length);
+    void (*free)(struct BeachGrid *this);
 } BeachGrid;
 
 #if defined(__cplusplus)
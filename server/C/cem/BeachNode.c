@@ -4,23 +4,16 @@
 #include "consts.h"
 #include "utils.h"
 #include <math.h>
+#include <stdlib.h>
 
-static int GetRow(struct BeachNode* this)
-{
-	return this->row;
-}
-
-static int GetCol(struct BeachNode* this)
-{
-	return this->col;
-}
-
-static double GetTransportPotential(struct BeachNode* this)
-{
-	return this->properties->transport_potential;
-}
+/* Node, its properties and (for boundaries) its frac_full in one pool block */
+struct NodeBlock {
+	struct BeachNode node;
+	struct BeachProperties properties;
+	double frac_full;
+};
 
-static int GetBoundaryRow(struct BeachNode* this)
+static int GetBoundaryRow(struct BeachNode* this, struct BeachGrid* grid)
 {
 	if (this->row != EMPTY_INT) { return this->row; }
 
@@ -29,20 +22,20 @@ static int GetBoundaryRow(struct BeachNode* this)
 	if (this->next)
 	{
 		otherNode = this->next;
-		angle = BeachNode.GetAngle(otherNode, otherNode->next);
-		cdist = otherNode->GetCol(otherNode) - this->col;
+		angle = BeachNode.GetAngle(grid, otherNode, otherNode->next);
+		cdist = BeachNode.GetCol(otherNode, grid) - this->col;
 	}
 	else
 	{
 		otherNode = this->prev;
-		angle = BeachNode.GetAngle(otherNode->prev, otherNode);
-		cdist = this->col - otherNode->GetCol(otherNode);
+		angle = BeachNode.GetAngle(grid, otherNode->prev, otherNode);
+		cdist = this->col - BeachNode.GetCol(otherNode, grid);
 	}
 	double rdist = cdist * tan(angle);
-	return (int)trunc(otherNode->GetRow(otherNode) + rdist);
+	return (int)trunc(BeachNode.GetRow(otherNode, grid) + rdist);
 }
 
-static int GetBoundaryCol(struct BeachNode* this)
+static int GetBoundaryCol(struct BeachNode* this, struct BeachGrid* grid)
 {
 	if (this->col != EMPTY_INT) { return this->col; }
 
@@ -51,41 +44,49 @@ static int GetBoundaryCol(struct BeachNode* this)
 	if (this->next)
 	{
 		otherNode = this->next;
-		angle = BeachNode.GetAngle(otherNode, otherNode->next);
-		rdist = otherNode->GetRow(otherNode) - this->row;
+		angle = BeachNode.GetAngle(grid, otherNode, otherNode->next);
+		rdist = BeachNode.GetRow(otherNode, grid) - this->row;
 	}
 	else
 	{
 		otherNode = this->prev;
-		angle = BeachNode.GetAngle(otherNode->prev, otherNode);
-		rdist = this->row - otherNode->GetRow(otherNode);
+		angle = BeachNode.GetAngle(grid, otherNode->prev, otherNode);
+		rdist = this->row - BeachNode.GetRow(otherNode, grid);
 	}
 
 	double cdist = rdist / tan(angle);
-	return (int)trunc(otherNode->GetCol(otherNode) + cdist);
+	return (int)trunc(BeachNode.GetCol(otherNode, grid) + cdist);
 }
 
-static double GetBoundaryTransportPotential(struct BeachNode* this)
+static int GetRow(struct BeachNode* this, struct BeachGrid* grid)
 {
-	if (this->next)
-	{
-		return this->next->properties->transport_potential;
-	}
-	return this->prev->properties->transport_potential;
+	return this->is_boundary ? GetBoundaryRow(this, grid) : this->row;
 }
 
-static FLOW_DIR GetBoundaryFlowDirection(struct BeachNode* this)
+static int GetCol(struct BeachNode* this, struct BeachGrid* grid)
 {
-	if (this->next) {
-		return this->next->properties->transport_dir;
+	return this->is_boundary ? GetBoundaryCol(this, grid) : this->col;
+}
+
+// boundaries report the transport potential of their neighboring node
+static double GetTransportPotential(struct BeachNode* this)
+{
+	if (this->is_boundary)
+	{
+		return this->next ? this->next->properties->transport_potential : this->prev->properties->transport_potential;
 	}
-	return this->prev->properties->transport_dir;
+	return this->properties->transport_potential;
 }
 
 static FLOW_DIR GetFlowDirection(struct BeachNode* this)
 {
+	if (this->is_boundary)
+	{
+		return this->next ? this->next->properties->transport_dir : this->prev->properties->transport_dir;
+	}
+
 	FLOW_DIR next_dir = this->properties->transport_dir;
-	FLOW_DIR prev_dir = this->prev->properties->transport_dir == EMPTY_INT ? this->prev->GetFlowDirection(this->prev) : this->prev->properties->transport_dir;
+	FLOW_DIR prev_dir = this->prev->properties->transport_dir == EMPTY_INT ? GetFlowDirection(this->prev) : this->prev->properties->transport_dir;
 
 	if (prev_dir == RIGHT)
 	{
@@ -115,54 +116,117 @@ static FLOW_DIR GetFlowDirection(struct BeachNode* this)
 	}
 }
 
-static struct BeachNode new(double frac_full, int r, int c){
-	return (struct BeachNode) {
-	.frac_full = frac_full,
-		.is_boundary = FALSE,
-		.row = r,
-		.col = c,
-		.next = NULL,
-		.prev = NULL,
-		.GetRow = &GetRow,
-		.GetCol = &GetCol,
-		.GetFlowDirection = &GetFlowDirection,
-		.GetTransportPotential = &GetTransportPotential,
-		.properties = NULL
+/* ---- NODE POOL ---- */
+#define NODE_CHUNK_SIZE 256
+
+struct NodeChunk {
+	struct NodeChunk* next;
+	struct NodeBlock blocks[NODE_CHUNK_SIZE];
+};
+
+static struct NodePool NewPool(void)
+{
+	return (struct NodePool) {
+		.first = NULL,
+		.current = NULL,
+		.used = 0,
+		.released = NULL
 	};
 }
 
-static struct BeachNode* boundary(int r, int c) {
-	struct BeachNode* ptr = malloc(sizeof(struct BeachNode));
-	struct BeachProperties* props = malloc(sizeof(struct BeachProperties));
-	*props = BeachProperties.new();
-	*ptr = (struct BeachNode){
-		.frac_full = EMPTY_double,
-		.is_boundary = TRUE,
+static void ResetPool(struct NodePool* pool)
+{
+	pool->current = pool->first;
+	pool->used = 0;
+	pool->released = NULL;
+}
+
+static void FreePool(struct NodePool* pool)
+{
+	struct NodeChunk* chunk = pool->first;
+	while (chunk)
+	{
+		struct NodeChunk* next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	*pool = NewPool();
+}
+
+static struct NodeBlock* TakeBlock(struct NodePool* pool)
+{
+	if (pool->released)
+	{
+		// node is the first member of its block
+		struct NodeBlock* block = (struct NodeBlock*)pool->released;
+		pool->released = pool->released->next;
+		return block;
+	}
+
+	if (!pool->current || pool->used == NODE_CHUNK_SIZE)
+	{
+		struct NodeChunk* next = pool->current ? pool->current->next : pool->first;
+		if (!next)
+		{
+			next = malloc(sizeof(struct NodeChunk));
+			next->next = NULL;
+			if (pool->current) { pool->current->next = next; }
+			else { pool->first = next; }
+		}
+		pool->current = next;
+		pool->used = 0;
+	}
+	return &pool->current->blocks[pool->used++];
+}
+
+static struct BeachNode* Allocate(struct NodePool* pool, int is_boundary, int r, int c)
+{
+	struct NodeBlock* block = TakeBlock(pool);
+	block->properties = BeachProperties.new();
+	block->frac_full = EMPTY_double;
+	block->node = (struct BeachNode){
+		.frac_full = &block->frac_full,
+		.is_boundary = is_boundary,
 		.row = r,
 		.col = c,
+		.order = 0,
+		.trace_stamp = 0,
 		.next = NULL,
 		.prev = NULL,
-		.GetRow = &GetBoundaryRow,
-		.GetCol = &GetBoundaryCol,
-		.GetFlowDirection = &GetBoundaryFlowDirection,
-		.GetTransportPotential = &GetBoundaryTransportPotential,
-		.properties = props
+		.properties = &block->properties
 	};
+	return &block->node;
+}
 
-	return ptr;
+static struct BeachNode* new(struct NodePool* pool, double* frac_full, int r, int c) {
+	struct BeachNode* node = Allocate(pool, FALSE, r, c);
+	node->frac_full = frac_full;
+	return node;
+}
+
+static struct BeachNode* boundary(struct NodePool* pool, int r, int c) {
+	return Allocate(pool, TRUE, r, c);
+}
+
+// return a single node to its pool for reuse
+static void FreeNode(struct NodePool* pool, struct BeachNode* node)
+{
+	node->next = pool->released;
+	pool->released = node;
 }
 
 /**
+* Rise and run of the segment from cell 1 to cell 2, in grid units
 * Angle scheme:
 * 90: left -> col1 == col2 && r1 > r2
 * 0: up (seaward) -> col1 < col2 && r1 == r2
 * -90: right -> col1 == col2 && r1 < r2
 */
-static double GetAngle(struct BeachNode* node1, struct BeachNode* node2)
+static void GetSegment(struct BeachGrid* grid, int row1, int col1, double frac_full1, int row2, int col2, double frac_full2, double* rise, double* run)
 {
-	double dR = node1->GetRow(node1) - node2->GetRow(node2);
-	double dC = node2->GetCol(node2) - node1->GetCol(node1);
-	double dF = node2->frac_full - node1->frac_full;
+	double dR = row1 - row2;
+	double dC = col2 - col1;
+	double dF = frac_full2 - frac_full1;
 
 	// vertical orientation
 	if (dC == 0)
@@ -176,17 +240,56 @@ static double GetAngle(struct BeachNode* node1, struct BeachNode* node2)
 		// subtract if bottom edge (dC < 0), add if top edge (dC > 0) 
 		dR += (dC / fabs(dC)) * dF;
 	}
-	double angle = atan2(dR * g_cell_length, dC * g_cell_width);
+	*rise = dR * grid->cell_length;
+	*run = dC * grid->cell_width;
+}
 
-	while (angle > PI)
-	{
-		angle -= 2.0 * PI;
-	}
-	while (angle < -PI)
+// Angles of count segments from their rise and run, in one atan2 loop; angles may alias either
+static void GetSegmentAngles(int count, const double* rise, const double* run, double* angles)
+{
+	int i;
+	for (i = 0; i < count; i++)
 	{
-		angle += 2.0 * PI;
+		double angle = atan2(rise[i], run[i]);
+
+		while (angle > PI)
+		{
+			angle -= 2.0 * PI;
+		}
+		while (angle < -PI)
+		{
+			angle += 2.0 * PI;
+		}
+		angles[i] = angle;
 	}
+}
+
+static double GetAngleBetween(struct BeachGrid* grid, int row1, int col1, double frac_full1, int row2, int col2, double frac_full2)
+{
+	double rise, run, angle;
+	GetSegment(grid, row1, col1, frac_full1, row2, col2, frac_full2, &rise, &run);
+	GetSegmentAngles(1, &rise, &run, &angle);
 	return angle;
 }
 
-const struct BeachNodeClass BeachNode = { .new = &new,.boundary = &boundary,.GetAngle = &GetAngle };
+static double GetAngle(struct BeachGrid* grid, struct BeachNode* node1, struct BeachNode* node2)
+{
+	return GetAngleBetween(grid, GetRow(node1, grid), GetCol(node1, grid), *node1->frac_full,
+		GetRow(node2, grid), GetCol(node2, grid), *node2->frac_full);
+}
+
+const struct NodePoolClass NodePool = { .new = &NewPool, .Reset = &ResetPool, .free = &FreePool };
+
+const struct BeachNodeClass BeachNode = {
+	.new = &new,
+	.boundary = &boundary,
+	.free = &FreeNode,
+	.GetRow = &GetRow,
+	.GetCol = &GetCol,
+	.GetFlowDirection = &GetFlowDirection,
+	.GetTransportPotential = &GetTransportPotential,
+	.GetAngle = &GetAngle,
+	.GetAngleBetween = &GetAngleBetween,
+	.GetSegment = &GetSegment,
+	.GetSegmentAngles = &GetSegmentAngles
+};
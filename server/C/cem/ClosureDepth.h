@@ -0,0 +1,37 @@
+#ifndef CEM_CLOSUREDEPTH_INCLUDED
+#define CEM_CLOSUREDEPTH_INCLUDED
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "consts.h"
+#include "config.h"
+
+/**
+ * Depth of closure of shoreline nodes: depthOfClosure when it is set, else
+ * found from the node's row and shore angle in one of the CLOSURE_DEPTH
+ * modes. The table modes evaluate the equations once per row and angle bin
+ * when the model is created, see ClosureDepth.c for the error.
+ */
+struct ClosureDepth {
+	int mode;
+	double fixed_depth;           /* depthOfClosure, 0 if found per node */
+	int ref_pos;
+	double ref_depth, shelf_slope, shoreface_slope, min_depth;
+	int cell_length;
+	int rows, num_bins;
+	double bin_width;             /* radians of |shore angle| per bin */
+	double* depth;                /* rows x (num_bins + 1), at |shore angle| = bin * bin_width, before the minimum */
+	double (*GetDepth)(const struct ClosureDepth* this, int row, double shore_angle);
+};
+extern const struct ClosureDepthClass {
+	struct ClosureDepth (*new)(Config config);
+	void (*free)(struct ClosureDepth* this);
+} ClosureDepth;
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
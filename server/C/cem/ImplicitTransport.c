@@ -0,0 +1,57 @@
+#include <stdlib.h>
+
+#include "ImplicitTransport.h"
+
+// Make room for a shoreline of length cells
+static void Reserve(struct ImplicitTransport* this, int length)
+{
+	int capacity = length + 2;
+	if (capacity <= this->capacity)
+	{
+		return;
+	}
+	if (capacity < 2 * this->capacity)
+	{
+		capacity = 2 * this->capacity;
+	}
+	this->alpha = realloc(this->alpha, 2 * capacity * sizeof(double));
+	this->potential = realloc(this->potential, 2 * capacity * sizeof(double));
+	this->coupling = realloc(this->coupling, capacity * sizeof(double));
+	this->depth = realloc(this->depth, capacity * sizeof(double));
+	this->volume_available = realloc(this->volume_available, capacity * sizeof(double));
+	this->diag = realloc(this->diag, capacity * sizeof(double));
+	this->rhs = realloc(this->rhs, capacity * sizeof(double));
+	this->change = realloc(this->change, capacity * sizeof(double));
+	this->capacity = capacity;
+}
+
+static struct ImplicitTransport new(void)
+{
+	return (struct ImplicitTransport) {
+		.capacity = 0,
+		.alpha = NULL,
+		.potential = NULL,
+		.coupling = NULL,
+		.depth = NULL,
+		.volume_available = NULL,
+		.diag = NULL,
+		.rhs = NULL,
+		.change = NULL,
+		.Reserve = &Reserve
+	};
+}
+
+static void FreeImplicitTransport(struct ImplicitTransport* this)
+{
+	free(this->alpha);
+	free(this->potential);
+	free(this->coupling);
+	free(this->depth);
+	free(this->volume_available);
+	free(this->diag);
+	free(this->rhs);
+	free(this->change);
+	*this = new();
+}
+
+const struct ImplicitTransportClass ImplicitTransport = { .new = &new, .free = &FreeImplicitTransport };
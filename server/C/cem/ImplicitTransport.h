@@ -0,0 +1,37 @@
+#ifndef CEM_IMPLICITTRANSPORT_INCLUDED
+#define CEM_IMPLICITTRANSPORT_INCLUDED
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "consts.h"
+
+/**
+ * Scratch of the arrays engine's implicit sediment budget, see
+ * SedimentBudgetImplicit: the alongshore flux linearized about the
+ * shoreline's current angles and the tridiagonal system it gives, by
+ * shoreline position as in struct Shoreline.
+ */
+struct ImplicitTransport {
+	int capacity;
+	double* alpha;                /* 2 per border: deep water angles either side of the border's, then their potentials */
+	double* potential;
+	double* coupling;             /* change of the border's signed flux per unit frac_full its downstream cell gains over its upstream one */
+	double* depth;                /* depth of closure */
+	double* volume_available;
+	double* diag;
+	double* rhs;
+	double* change;               /* frac_full change of each cell */
+	void (*Reserve)(struct ImplicitTransport* this, int length);
+};
+extern const struct ImplicitTransportClass {
+	struct ImplicitTransport (*new)(void);
+	void (*free)(struct ImplicitTransport* this);
+} ImplicitTransport;
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
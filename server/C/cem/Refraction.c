@@ -0,0 +1,627 @@
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "Refraction.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+
+// keep the march kernels from fusing products into AVX-512 FMAs, see MarchNodes
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#define NO_FP_CONTRACT
+#else
+#define NO_FP_CONTRACT __attribute__((optimize("fp-contract=off")))
+#endif
+#endif
+
+#define REFRACT_STEP 0.2                  // (meters) step size to iterate through depth
+#define K_BREAK 0.5                       // coefficient such that waves break at Hs > k_break*depth
+#define DEFAULT_TOLERANCE 1e-3            // (meters) breaking depth tolerance of the solver
+#define MAX_SOLVER_ITERATIONS 100
+#define BRACKET_STEP 0.05                 // first bracketing step of the solver, relative to its guess
+
+/**
+ * Transport potential table: REFRACTION_TABLE_SIZE intervals over |alpha_deep|
+ * up to the steepest angle WaveTransformation refracts. The march breaks at
+ * whole depth steps, so the potential jumps wherever the breaking step changes
+ * with the angle; intervals across such a jump are not interpolated but
+ * marched exactly. Elsewhere the interpolated potential stays within 5e-5 of
+ * the table's largest potential (measured for wave heights 0.3 - 4 m and
+ * periods 3 - 16 s, where about 3% of angles fall in marched intervals).
+ */
+#define REFRACTION_TABLE_SIZE 512
+#define MAX_ALPHA_DEEP (0.995 * PI / 2)
+
+static double GetTransportVolumePotential(double alpha, double wave_height, double timestep_length, double k)
+{
+	int rho = 1020;         // (kg/m^3) density of salt water
+	return fabs(k * rho * pow(GRAVITY, 3.0 / 2.0) * pow(wave_height, 5.0 / 2.0) * cos(alpha) * sin(alpha) * timestep_length);
+}
+
+// Factor of the transport volume potential that is the same for every node
+static double GetTransportVolumeScale(double timestep_length, double k)
+{
+	int rho = 1020;         // (kg/m^3) density of salt water
+	return k * rho * pow(GRAVITY, 3.0 / 2.0) * timestep_length;
+}
+
+/**
+ * Celerity terms of the current wave at a depth: local over deep water
+ * celerity, and local celerity * 2n
+ */
+static void GetDepthTerms(const struct Refraction* this, double local_depth, double* c_ratio, double* c_group)
+{
+	// non-iterative eqn or L, from Fenton & McKee
+	double wave_length = this->l_deep * pow(tanh(pow(pow(2.0 * PI / this->wave_period, 2.0) * local_depth / GRAVITY, .75)), 2.0 / 3.0);
+	double local_c = wave_length / this->wave_period;
+
+	// n = 1/2(1+2kh/sinh(kh)) Komar 5.21
+	// kh = 2 pi depth/L  from k = 2 pi/L
+	double kh = 2 * PI * local_depth / wave_length;
+	double n = 0.5 * (1 + 2.0 * kh / sinh(2.0 * kh));
+
+	*c_ratio = local_c / this->c_deep;
+	*c_group = local_c * 2.0 * n;
+}
+
+/**
+ * Refract a wave to a depth
+ * RETURN: how far its height exceeds the breaking height there
+ */
+static double Refract(double wave_height, double sin_alpha, double c_cos, double c_ratio, double c_group, double local_depth,
+	double* local_alpha, double* local_wave_height)
+{
+	// Calculate angle, assuming shore parallel contours and no conv/div of rays from Komar 5.47q1
+	*local_alpha = asin(c_ratio * sin_alpha);
+
+	// Determine wave height from refract calcs, from Komar 5.49
+	*local_wave_height = wave_height * sqrt(fabs(c_cos / (c_group * cos(*local_alpha))));
+
+	return *local_wave_height - K_BREAK * local_depth;
+}
+
+static void Reserve(struct Refraction* this, int capacity)
+{
+	if (capacity <= this->capacity)
+	{
+		return;
+	}
+	if (capacity < 2 * this->capacity)
+	{
+		capacity = 2 * this->capacity;
+	}
+	this->depth = realloc(this->depth, capacity * sizeof(double));
+	this->c_ratio = realloc(this->c_ratio, capacity * sizeof(double));
+	this->c_group = realloc(this->c_group, capacity * sizeof(double));
+	this->break_factor = realloc(this->break_factor, capacity * sizeof(double));
+	this->capacity = capacity;
+}
+
+/**
+ * Refract a deep water wave over shore parallel contours until it breaks
+ * RETURN: breaking angle and height, and the march step it breaks at
+ */
+static int March(const struct Refraction* this, double alpha_deep, double* local_alpha, double* local_wave_height)
+{
+	double sin_alpha = sin(alpha_deep);
+	double c_cos = this->c_deep * cos(alpha_deep);
+	int i;
+	for (i = 0; i < this->num_steps; i++)
+	{
+		// wave break condition, the last step is at most REFRACT_STEP deep
+		if (Refract(this->wave_height, sin_alpha, c_cos, this->c_ratio[i], this->c_group[i], this->depth[i], local_alpha, local_wave_height) > 0)
+		{
+			break;
+		}
+	}
+	return i < this->num_steps ? i : this->num_steps - 1;
+}
+
+struct DepthTerms {
+	double depth, c_ratio, c_group;
+};
+
+/**
+ * March kernels of REFRACTION_VECTOR: count nodes marched side by side through
+ * the depth steps, potentials[n] = |scale * H^2.5 * cos * sin| of the local
+ * angle at breaking. Squaring the break condition twice leaves only products
+ * per step: (H^2 * c_cos)^2 > break_factor * cos^2(local_alpha), with
+ * cos^2 = (1 - x)(1 + x) for x = sin(local_alpha) = c_ratio * sin(alpha_deep).
+ * The angle and height are only taken at the breaking step, with square
+ * roots. Products, quotients and square roots round the same at any vector
+ * width and there is no a * b + c to fuse, so every kernel gives the scalar
+ * kernel's result bit for bit. Against the asin, cos and pow of March they
+ * differ by a few ulps, which moves a break by one step only where a step
+ * ties with the breaking height.
+ */
+static void MarchNodes(const struct Refraction* this, const double* alpha_deep, int count, double scale, double* potentials)
+{
+	int n;
+	for (n = 0; n < count; n++)
+	{
+		double sin_alpha = sin(alpha_deep[n]);
+		double c_cos = this->c_deep * cos(alpha_deep[n]);
+		double flux = this->wave_height * this->wave_height * c_cos;
+		flux = flux * flux;
+
+		int i;
+		for (i = 0; i < this->num_steps - 1; i++)
+		{
+			double x = this->c_ratio[i] * sin_alpha;
+			if (flux > this->break_factor[i] * ((1 - x) * (1 + x)))
+			{
+				break;
+			}
+		}
+
+		double x = this->c_ratio[i] * sin_alpha;
+		double cos_local = sqrt((1 - x) * (1 + x));
+		double local_wave_height = this->wave_height * sqrt(fabs(c_cos / (this->c_group[i] * cos_local)));
+		potentials[n] = fabs(scale * (local_wave_height * local_wave_height * sqrt(local_wave_height)) * cos_local * x);
+	}
+}
+
+#ifdef HAVE_X86_KERNELS
+__attribute__((target("avx2"))) NO_FP_CONTRACT
+static void MarchNodesAVX2(const struct Refraction* this, const double* alpha_deep, int count, double scale, double* potentials)
+{
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d sign = _mm256_set1_pd(-0.0);
+	const __m256d wave_height = _mm256_set1_pd(this->wave_height);
+	int n;
+	for (n = 0; n + 4 <= count; n += 4)
+	{
+		double sines[4], c_cosines[4];
+		int j;
+		for (j = 0; j < 4; j++)
+		{
+			sines[j] = sin(alpha_deep[n + j]);
+			c_cosines[j] = this->c_deep * cos(alpha_deep[n + j]);
+		}
+		__m256d sin_alpha = _mm256_loadu_pd(sines);
+		__m256d c_cos = _mm256_loadu_pd(c_cosines);
+		__m256d flux = _mm256_mul_pd(_mm256_mul_pd(wave_height, wave_height), c_cos);
+		flux = _mm256_mul_pd(flux, flux);
+
+		// lanes keep the terms of each step until they break
+		__m256d c_ratio = _mm256_setzero_pd(), c_group = c_ratio, broken = c_ratio;
+		int i;
+		for (i = 0; i < this->num_steps; i++)
+		{
+			__m256d step_ratio = _mm256_set1_pd(this->c_ratio[i]);
+			__m256d x = _mm256_mul_pd(step_ratio, sin_alpha);
+			__m256d cos_squared = _mm256_mul_pd(_mm256_sub_pd(one, x), _mm256_add_pd(one, x));
+			c_ratio = _mm256_blendv_pd(step_ratio, c_ratio, broken);
+			c_group = _mm256_blendv_pd(_mm256_set1_pd(this->c_group[i]), c_group, broken);
+			broken = _mm256_or_pd(broken, _mm256_cmp_pd(flux, _mm256_mul_pd(_mm256_set1_pd(this->break_factor[i]), cos_squared), _CMP_GT_OQ));
+			if (_mm256_movemask_pd(broken) == 0xF)
+			{
+				break;
+			}
+		}
+
+		__m256d x = _mm256_mul_pd(c_ratio, sin_alpha);
+		__m256d cos_local = _mm256_sqrt_pd(_mm256_mul_pd(_mm256_sub_pd(one, x), _mm256_add_pd(one, x)));
+		__m256d local_wave_height = _mm256_mul_pd(wave_height, _mm256_sqrt_pd(_mm256_andnot_pd(sign,
+			_mm256_div_pd(c_cos, _mm256_mul_pd(c_group, cos_local)))));
+		__m256d h = _mm256_mul_pd(_mm256_mul_pd(local_wave_height, local_wave_height), _mm256_sqrt_pd(local_wave_height));
+		__m256d potential = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(scale), h), cos_local), x);
+		_mm256_storeu_pd(potentials + n, _mm256_andnot_pd(sign, potential));
+	}
+	MarchNodes(this, alpha_deep + n, count - n, scale, potentials + n);
+}
+
+__attribute__((target("avx512f"))) NO_FP_CONTRACT
+static void MarchNodesAVX512(const struct Refraction* this, const double* alpha_deep, int count, double scale, double* potentials)
+{
+	const __m512d one = _mm512_set1_pd(1.0);
+	const __m512d wave_height = _mm512_set1_pd(this->wave_height);
+	int n;
+	for (n = 0; n + 8 <= count; n += 8)
+	{
+		double sines[8], c_cosines[8];
+		int j;
+		for (j = 0; j < 8; j++)
+		{
+			sines[j] = sin(alpha_deep[n + j]);
+			c_cosines[j] = this->c_deep * cos(alpha_deep[n + j]);
+		}
+		__m512d sin_alpha = _mm512_loadu_pd(sines);
+		__m512d c_cos = _mm512_loadu_pd(c_cosines);
+		__m512d flux = _mm512_mul_pd(_mm512_mul_pd(wave_height, wave_height), c_cos);
+		flux = _mm512_mul_pd(flux, flux);
+
+		// lanes keep the terms of each step until they break
+		__m512d c_ratio = _mm512_setzero_pd(), c_group = c_ratio;
+		__mmask8 broken = 0;
+		int i;
+		for (i = 0; i < this->num_steps; i++)
+		{
+			__m512d step_ratio = _mm512_set1_pd(this->c_ratio[i]);
+			__m512d x = _mm512_mul_pd(step_ratio, sin_alpha);
+			__m512d cos_squared = _mm512_mul_pd(_mm512_sub_pd(one, x), _mm512_add_pd(one, x));
+			c_ratio = _mm512_mask_blend_pd(broken, step_ratio, c_ratio);
+			c_group = _mm512_mask_blend_pd(broken, _mm512_set1_pd(this->c_group[i]), c_group);
+			broken |= _mm512_cmp_pd_mask(flux, _mm512_mul_pd(_mm512_set1_pd(this->break_factor[i]), cos_squared), _CMP_GT_OQ);
+			if (broken == 0xFF)
+			{
+				break;
+			}
+		}
+
+		__m512d x = _mm512_mul_pd(c_ratio, sin_alpha);
+		__m512d cos_local = _mm512_sqrt_pd(_mm512_mul_pd(_mm512_sub_pd(one, x), _mm512_add_pd(one, x)));
+		__m512d local_wave_height = _mm512_mul_pd(wave_height, _mm512_sqrt_pd(_mm512_abs_pd(
+			_mm512_div_pd(c_cos, _mm512_mul_pd(c_group, cos_local)))));
+		__m512d h = _mm512_mul_pd(_mm512_mul_pd(local_wave_height, local_wave_height), _mm512_sqrt_pd(local_wave_height));
+		__m512d potential = _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(_mm512_set1_pd(scale), h), cos_local), x);
+		_mm512_storeu_pd(potentials + n, _mm512_abs_pd(potential));
+	}
+	MarchNodesAVX2(this, alpha_deep + n, count - n, scale, potentials + n);
+}
+#endif
+
+// Widest march kernel the CPU runs
+static MarchKernel SelectMarchKernel(void)
+{
+#ifdef HAVE_X86_KERNELS
+	if (__builtin_cpu_supports("avx512f"))
+	{
+		return &MarchNodesAVX512;
+	}
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return &MarchNodesAVX2;
+	}
+#endif
+	return &MarchNodes;
+}
+
+/**
+ * March REFRACTION_VECTOR nodes on the kernel of width lanes: 1 for the
+ * scalar kernel, 4 for AVX2, 8 for AVX-512
+ * RETURN: 0 on success, -1 if the CPU does not run that kernel
+ */
+static int UseMarchKernel(struct Refraction* this, int width)
+{
+	if (width == 1)
+	{
+		this->MarchNodes = &MarchNodes;
+		return 0;
+	}
+#ifdef HAVE_X86_KERNELS
+	if (width == 8 && __builtin_cpu_supports("avx512f"))
+	{
+		this->MarchNodes = &MarchNodesAVX512;
+		return 0;
+	}
+	if (width == 4 && __builtin_cpu_supports("avx2"))
+	{
+		this->MarchNodes = &MarchNodesAVX2;
+		return 0;
+	}
+#endif
+	return -1;
+}
+
+/**
+ * Excess of the current wave's height over the breaking height at a depth,
+ * refracted from alpha_deep (given as its sine and c_deep * cosine). Keeps
+ * the depth terms in breaking if the wave breaks there, or if it is within
+ * REFRACT_STEP of the shore.
+ */
+static double GetBreakingExcess(const struct Refraction* this, double sin_alpha, double c_cos, double local_depth,
+	struct DepthTerms* breaking)
+{
+	struct DepthTerms terms = { .depth = local_depth };
+	GetDepthTerms(this, local_depth, &terms.c_ratio, &terms.c_group);
+
+	// as Refract, with cos(asin(x)) = sqrt(1 - x^2)
+	double sin_local = terms.c_ratio * sin_alpha;
+	double excess = this->wave_height * sqrt(fabs(c_cos / (terms.c_group * sqrt(1 - sin_local * sin_local)))) - K_BREAK * local_depth;
+	if (excess >= 0 || local_depth <= REFRACT_STEP)
+	{
+		*breaking = terms;
+	}
+	return excess;
+}
+
+static void FindRoot(const struct Refraction* this, double sin_alpha, double c_cos, double a, double fa, double b, double fb,
+	struct DepthTerms* breaking);
+
+/**
+ * Refract a deep water wave to the depth where it breaks, found with Brent's
+ * method to within the tolerance. The root is bracketed by walking out from
+ * a shallow water estimate, within 5% of it for all but short steep waves.
+ * Like the march, waves already breaking at 3 * wave_height break there and
+ * waves that would not break before REFRACT_STEP break at REFRACT_STEP.
+ * RETURN: breaking angle and height
+ */
+static void Solve(const struct Refraction* this, double alpha_deep, double* local_alpha, double* local_wave_height)
+{
+	double sin_alpha = sin(alpha_deep);
+	double c_cos = this->c_deep * cos(alpha_deep);
+	double max_depth = 3 * this->wave_height;
+
+	// conserve energy flux in shallow water up to breaking, with cos(local_alpha) ~ 1
+	double guess = pow(this->wave_height * this->wave_height * this->wave_period * fabs(cos(alpha_deep)) *
+		sqrt(GRAVITY * K_BREAK) / (4 * PI), 0.4) / K_BREAK;
+
+	// walk away from the guess in doubling steps until the excess changes sign
+	struct DepthTerms breaking;
+	double a = fmin(fmax(guess, REFRACT_STEP), max_depth);
+	double fa = GetBreakingExcess(this, sin_alpha, c_cos, a, &breaking);
+	double b, fb;
+	double step = BRACKET_STEP * a;
+	while (TRUE)
+	{
+		if (fa > 0)
+		{
+			if (a >= max_depth)
+			{
+				break;
+			}
+			b = fmin(a + step, max_depth);
+		}
+		else
+		{
+			if (a <= REFRACT_STEP)
+			{
+				break;
+			}
+			b = fmax(a - step, REFRACT_STEP);
+		}
+		fb = GetBreakingExcess(this, sin_alpha, c_cos, b, &breaking);
+		if ((fa > 0) != (fb > 0))
+		{
+			FindRoot(this, sin_alpha, c_cos, a, fa, b, fb, &breaking);
+			break;
+		}
+		a = b;
+		fa = fb;
+		step *= 2;
+	}
+
+	Refract(this->wave_height, sin_alpha, c_cos, breaking.c_ratio, breaking.c_group, breaking.depth, local_alpha, local_wave_height);
+}
+
+/**
+ * Brent's method on a bracket [a, b] of the breaking excess, to within the
+ * tolerance. The last breaking depth evaluated is kept in breaking.
+ */
+static void FindRoot(const struct Refraction* this, double sin_alpha, double c_cos, double a, double fa, double b, double fb,
+	struct DepthTerms* breaking)
+{
+
+	// b is the best estimate so far, c the other end of the bracket and d the step before last
+	double c = a, fc = fa;
+	double d = b - a, e = d;
+	int i;
+	for (i = 0; i < MAX_SOLVER_ITERATIONS; i++)
+	{
+		if ((fb > 0) == (fc > 0))
+		{
+			c = a;
+			fc = fa;
+			d = e = b - a;
+		}
+		if (fabs(fc) < fabs(fb))
+		{
+			a = b;
+			b = c;
+			c = a;
+			fa = fb;
+			fb = fc;
+			fc = fa;
+		}
+
+		double tolerance = 2.0 * DBL_EPSILON * fabs(b) + 0.5 * this->tolerance;
+		double m = 0.5 * (c - b);
+		if (fabs(m) <= tolerance || fb == 0)
+		{
+			break;
+		}
+
+		if (fabs(e) >= tolerance && fabs(fa) > fabs(fb))
+		{
+			// secant or inverse quadratic interpolation
+			double p, q, r;
+			double s = fb / fa;
+			if (a == c)
+			{
+				p = 2.0 * m * s;
+				q = 1.0 - s;
+			}
+			else
+			{
+				q = fa / fc;
+				r = fb / fc;
+				p = s * (2.0 * m * q * (q - r) - (b - a) * (r - 1.0));
+				q = (q - 1.0) * (r - 1.0) * (s - 1.0);
+			}
+			if (p > 0)
+			{
+				q = -q;
+			}
+			else
+			{
+				p = -p;
+			}
+
+			if (2.0 * p < fmin(3.0 * m * q - fabs(tolerance * q), fabs(e * q)))
+			{
+				e = d;
+				d = p / q;
+			}
+			else
+			{
+				d = e = m;
+			}
+		}
+		else
+		{
+			// bisection
+			d = e = m;
+		}
+
+		a = b;
+		fa = fb;
+		b += fabs(d) > tolerance ? d : (m > 0 ? tolerance : -tolerance);
+		fb = GetBreakingExcess(this, sin_alpha, c_cos, b, breaking);
+	}
+}
+
+static void BuildTable(struct Refraction* this)
+{
+	if (!this->potential)
+	{
+		this->potential = malloc((REFRACTION_TABLE_SIZE + 1) * sizeof(double));
+		this->break_step = malloc((REFRACTION_TABLE_SIZE + 1) * sizeof(int));
+	}
+	int i;
+	for (i = 0; i <= REFRACTION_TABLE_SIZE; i++)
+	{
+		double local_alpha, local_wave_height;
+		this->break_step[i] = March(this, i * (MAX_ALPHA_DEEP / REFRACTION_TABLE_SIZE), &local_alpha, &local_wave_height);
+		this->potential[i] = GetTransportVolumePotential(local_alpha, local_wave_height, 1.0, 1.0);
+	}
+}
+
+/**
+ * Set the current wave. Unless solving, also lay out its depth march:
+ * celerity and group terms per step from 3 * wave_height down to the first
+ * depth within REFRACT_STEP of the shore
+ */
+static void SetWave(struct Refraction* this, double wave_height, double wave_period)
+{
+	if (wave_height == this->wave_height && wave_period == this->wave_period)
+	{
+		return;
+	}
+	this->wave_height = wave_height;
+	this->wave_period = wave_period;
+	this->c_deep = (GRAVITY * wave_period) / (2 * PI);
+	this->l_deep = this->c_deep * wave_period;
+	if (this->mode == REFRACTION_SOLVE)
+	{
+		return;
+	}
+
+	double local_depth = 3 * wave_height;
+	int i = 0;
+	while (TRUE)
+	{
+		Reserve(this, i + 1);
+		this->depth[i] = local_depth;
+		GetDepthTerms(this, local_depth, &this->c_ratio[i], &this->c_group[i]);
+		double break_height = K_BREAK * local_depth;
+		this->break_factor[i] = break_height * break_height * break_height * break_height * this->c_group[i] * this->c_group[i];
+		i++;
+
+		if (local_depth <= REFRACT_STEP)
+		{
+			break;
+		}
+		local_depth -= REFRACT_STEP;
+	}
+	this->num_steps = i;
+
+	if (this->mode == REFRACTION_TABLE)
+	{
+		BuildTable(this);
+	}
+}
+
+/**
+ * Alongshore transport volume potential of the current wave breaking from
+ * alpha_deep, interpolated from the table when there is one
+ */
+static double GetTransportPotential(struct Refraction* this, double alpha_deep, double timestep_length, double k)
+{
+	double local_alpha, local_wave_height;
+	if (this->mode == REFRACTION_VECTOR)
+	{
+		double potential;
+		MarchNodes(this, &alpha_deep, 1, GetTransportVolumeScale(timestep_length, k), &potential);
+		return potential;
+	}
+	if (this->mode == REFRACTION_SOLVE)
+	{
+		Solve(this, alpha_deep, &local_alpha, &local_wave_height);
+		return GetTransportVolumePotential(local_alpha, local_wave_height, timestep_length, k);
+	}
+
+	if (this->mode == REFRACTION_TABLE)
+	{
+		double x = fabs(alpha_deep) * (REFRACTION_TABLE_SIZE / MAX_ALPHA_DEEP);
+		int i = (int)x;
+		if (i < REFRACTION_TABLE_SIZE && this->break_step[i] == this->break_step[i + 1])
+		{
+			double f = x - i;
+			return fabs(k * timestep_length) * (this->potential[i] + (this->potential[i + 1] - this->potential[i]) * f);
+		}
+	}
+
+	March(this, alpha_deep, &local_alpha, &local_wave_height);
+	return GetTransportVolumePotential(local_alpha, local_wave_height, timestep_length, k);
+}
+
+/**
+ * Transport volume potentials of count nodes breaking from alpha_deep, in
+ * batches on the march kernel with REFRACTION_VECTOR. An alpha_deep of 0
+ * carries no transport.
+ */
+static void GetTransportPotentials(struct Refraction* this, const double* alpha_deep, int count, double timestep_length, double k, double* potentials)
+{
+	if (this->mode == REFRACTION_VECTOR)
+	{
+		this->MarchNodes(this, alpha_deep, count, GetTransportVolumeScale(timestep_length, k), potentials);
+		return;
+	}
+	int n;
+	for (n = 0; n < count; n++)
+	{
+		potentials[n] = alpha_deep[n] == 0 ? 0.0 : GetTransportPotential(this, alpha_deep[n], timestep_length, k);
+	}
+}
+
+static struct Refraction new(int mode, double tolerance)
+{
+	return (struct Refraction) {
+		.mode = mode,
+		.tolerance = tolerance > 0 ? tolerance : DEFAULT_TOLERANCE,
+		.wave_height = EMPTY_double,
+		.wave_period = EMPTY_double,
+		.c_deep = 0.0,
+		.l_deep = 0.0,
+		.num_steps = 0,
+		.capacity = 0,
+		.depth = NULL,
+		.c_ratio = NULL,
+		.c_group = NULL,
+		.break_factor = NULL,
+		.potential = NULL,
+		.break_step = NULL,
+		.MarchNodes = SelectMarchKernel(),
+		.UseMarchKernel = &UseMarchKernel,
+		.SetWave = &SetWave,
+		.GetTransportPotential = &GetTransportPotential,
+		.GetTransportPotentials = &GetTransportPotentials
+	};
+}
+
+static void FreeRefraction(struct Refraction* this)
+{
+	free(this->depth);
+	free(this->c_ratio);
+	free(this->c_group);
+	free(this->break_factor);
+	free(this->potential);
+	free(this->break_step);
+	*this = new(this->mode, this->tolerance);
+}
+
+const struct RefractionClass Refraction = { .new = &new, .free = &FreeRefraction };
@@ -0,0 +1,52 @@
+#ifndef CEM_REFRACTION_INCLUDED
+#define CEM_REFRACTION_INCLUDED
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "consts.h"
+#include "config.h"
+
+/**
+ * Refraction of the current deep water wave over shore parallel contours
+ * down to breaking, in one of the REFRACTION modes. The terms of the depth
+ * march that only depend on depth are kept per march step and rebuilt when
+ * the wave height or period changes. REFRACTION_TABLE also tabulates
+ * transport potentials over the deep water angle and interpolates them, see
+ * Refraction.c for the error. REFRACTION_SOLVE skips the march and solves
+ * for the breaking depth to within tolerance meters. REFRACTION_VECTOR
+ * marches batches of nodes at once on the widest kernel the CPU runs, or
+ * the one UseMarchKernel picks.
+ */
+struct Refraction;
+typedef void (*MarchKernel)(const struct Refraction* this, const double* alpha_deep, int count, double scale, double* potentials);
+
+struct Refraction {
+	int mode;
+	double tolerance;
+	double wave_height, wave_period;
+	double c_deep, l_deep;        /* deep water celerity and wave length */
+	int num_steps, capacity;
+	double* depth;                /* per march step, from 3 * wave_height down */
+	double* c_ratio;              /* local over deep water celerity */
+	double* c_group;              /* local celerity * 2n */
+	double* break_factor;         /* (K_BREAK * depth)^4 * c_group^2, for the march kernels */
+	double* potential;            /* per tabulated |alpha_deep|, potential for unit k and timestep */
+	int* break_step;              /* per tabulated |alpha_deep|, march step the wave breaks at */
+	MarchKernel MarchNodes;
+	int (*UseMarchKernel)(struct Refraction* this, int width);
+	void (*SetWave)(struct Refraction* this, double wave_height, double wave_period);
+	double (*GetTransportPotential)(struct Refraction* this, double alpha_deep, double timestep_length, double k);
+	void (*GetTransportPotentials)(struct Refraction* this, const double* alpha_deep, int count, double timestep_length, double k, double* potentials);
+};
+extern const struct RefractionClass {
+	struct Refraction (*new)(int mode, double tolerance);
+	void (*free)(struct Refraction* this);
+} Refraction;
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -0,0 +1,174 @@
+#include <stdlib.h>
+
+#include "Shoreline.h"
+#include "BeachProperties.h"
+#include "BeachNode.h"
+#include "BeachGrid.h"
+#include "consts.h"
+
+static void Reserve(struct Shoreline* this, int capacity)
+{
+	if (capacity <= this->capacity)
+	{
+		return;
+	}
+	if (capacity < 2 * this->capacity)
+	{
+		capacity = 2 * this->capacity;
+	}
+	this->nodes = realloc(this->nodes, capacity * sizeof(struct BeachNode*));
+	this->row = realloc(this->row, capacity * sizeof(int));
+	this->col = realloc(this->col, capacity * sizeof(int));
+	this->frac_full = realloc(this->frac_full, capacity * sizeof(double));
+	this->prev_angle = realloc(this->prev_angle, capacity * sizeof(double));
+	this->next_angle = realloc(this->next_angle, capacity * sizeof(double));
+	this->surrounding_angle = realloc(this->surrounding_angle, capacity * sizeof(double));
+	this->alpha_deep = realloc(this->alpha_deep, capacity * sizeof(double));
+	this->transport_potential = realloc(this->transport_potential, capacity * sizeof(double));
+	this->net_volume_change = realloc(this->net_volume_change, capacity * sizeof(double));
+	this->transport_dir = realloc(this->transport_dir, capacity * sizeof(FLOW_DIR));
+	this->in_shadow = realloc(this->in_shadow, capacity * sizeof(int));
+	this->capacity = capacity;
+}
+
+// Walk the next/prev chain once and record its nodes in shoreline order
+static void Pack(struct Shoreline* this, struct BeachGrid* grid)
+{
+	this->version = grid->shoreline_version;
+	this->length = 0;
+	struct BeachNode* head = grid->shoreline;
+	if (!head || head->is_boundary || !head->prev)
+	{
+		return;
+	}
+
+	int length = 0;
+	struct BeachNode* curr;
+	for (curr = head; !curr->is_boundary; curr = curr->next)
+	{
+		length++;
+	}
+	Reserve(this, length + 2);
+
+	int i = 0;
+	this->nodes[i++] = head->prev;
+	for (curr = head; !curr->is_boundary; curr = curr->next)
+	{
+		this->nodes[i] = curr;
+		this->row[i] = curr->row;
+		this->col[i] = curr->col;
+		i++;
+	}
+	this->nodes[i] = curr;
+	this->length = length;
+}
+
+/**
+ * Bring the arrays up to date with the grid at the start of a timestep:
+ * repack if the chain was relinked, gather frac_full and compute the
+ * prev/next/surrounding angles the BeachGrid getters would return
+ */
+static void Load(struct Shoreline* this, struct BeachGrid* grid)
+{
+	if (this->version != grid->shoreline_version)
+	{
+		Pack(this, grid);
+	}
+	int n = this->length;
+	if (n == 0)
+	{
+		return;
+	}
+
+	int i;
+	for (i = 1; i <= n; i++)
+	{
+		this->frac_full[i] = *this->nodes[i]->frac_full;
+	}
+
+	// next_angle[i] holds the segment angle from cell i to cell i + 1, from its
+	// rise (in prev_angle until overwritten below) and run
+	for (i = 1; i < n; i++)
+	{
+		BeachNode.GetSegment(grid, this->row[i], this->col[i], this->frac_full[i],
+			this->row[i + 1], this->col[i + 1], this->frac_full[i + 1], &this->prev_angle[i], &this->next_angle[i]);
+	}
+	BeachNode.GetSegmentAngles(n - 1, this->prev_angle + 1, this->next_angle + 1, this->next_angle + 1);
+	for (i = 2; i <= n; i++)
+	{
+		this->prev_angle[i] = this->next_angle[i - 1];
+	}
+	// end cells reuse their only segment
+	this->prev_angle[1] = n > 1 ? this->next_angle[1] : EMPTY_double;
+	this->next_angle[n] = n > 1 ? this->prev_angle[n] : EMPTY_double;
+
+	for (i = 1; i <= n; i++)
+	{
+		this->surrounding_angle[i] = (this->prev_angle[i] + this->next_angle[i]) / 2;
+	}
+
+	// boundaries take the angle of their neighboring cell
+	this->prev_angle[0] = this->next_angle[0] = this->surrounding_angle[0] = this->next_angle[1];
+	this->prev_angle[n + 1] = this->next_angle[n + 1] = this->surrounding_angle[n + 1] = this->prev_angle[n];
+
+	for (i = 0; i <= n + 1; i++)
+	{
+		this->transport_potential[i] = 0.0;
+		this->net_volume_change[i] = 0.0;
+		this->in_shadow[i] = EMPTY_INT;
+	}
+	this->transport_dir[0] = this->nodes[0]->properties->transport_dir;
+	this->transport_dir[n + 1] = this->nodes[n + 1]->properties->transport_dir;
+}
+
+// Write frac_full back to the grid cells
+static void Store(struct Shoreline* this)
+{
+	int i;
+	for (i = 1; i <= this->length; i++)
+	{
+		*this->nodes[i]->frac_full = this->frac_full[i];
+	}
+}
+
+static struct Shoreline new(void)
+{
+	return (struct Shoreline) {
+		.length = 0,
+		.capacity = 0,
+		.version = EMPTY_INT,
+		.nodes = NULL,
+		.row = NULL,
+		.col = NULL,
+		.frac_full = NULL,
+		.prev_angle = NULL,
+		.next_angle = NULL,
+		.surrounding_angle = NULL,
+		.alpha_deep = NULL,
+		.transport_potential = NULL,
+		.net_volume_change = NULL,
+		.transport_dir = NULL,
+		.in_shadow = NULL,
+		.Load = &Load,
+		.Store = &Store
+	};
+}
+
+static void FreeShoreline(struct Shoreline* this)
+{
+	free(this->nodes);
+	free(this->row);
+	free(this->col);
+	free(this->frac_full);
+	free(this->prev_angle);
+	free(this->next_angle);
+	free(this->surrounding_angle);
+	free(this->alpha_deep);
+	free(this->transport_potential);
+	free(this->net_volume_change);
+	free(this->transport_dir);
+	free(this->in_shadow);
+	*this = new();
+}
+
+const struct ShorelineClass Shoreline = { .new = &new, .free = &FreeShoreline };
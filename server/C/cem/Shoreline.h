@@ -0,0 +1,44 @@
+#ifndef CEM_SHORELINE_INCLUDED
+#define CEM_SHORELINE_INCLUDED
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "consts.h"
+#include "BeachNode.h"
+#include "BeachGrid.h"
+
+/**
+ * Traced shoreline as contiguous arrays indexed by shoreline position:
+ * 0 is the start boundary, 1..length the beach cells in next order and
+ * length + 1 the end boundary. Used by the array engine of sedtrans.c in
+ * place of the next/prev chain and per-node BeachProperties.
+ */
+struct Shoreline {
+	int length, capacity, version;
+	struct BeachNode** nodes;
+	int* row;
+	int* col;
+	double* frac_full;
+	double* prev_angle;
+	double* next_angle;
+	double* surrounding_angle;
+	double* alpha_deep;           /* deep water wave angle to the shore, 0 where it moves no sediment */
+	double* transport_potential;
+	double* net_volume_change;
+	FLOW_DIR* transport_dir;
+	int* in_shadow;
+	void (*Load)(struct Shoreline* this, struct BeachGrid* grid);
+	void (*Store)(struct Shoreline* this);
+};
+extern const struct ShorelineClass {
+	struct Shoreline (*new)(void);
+	void (*free)(struct Shoreline* this);
+} Shoreline;
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -0,0 +1,232 @@
+#include <stdlib.h>
+
+#include "ThreadPool.h"
+#include "consts.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <process.h>
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#define mutex_init(m) InitializeCriticalSection(m)
+#define mutex_destroy(m) DeleteCriticalSection(m)
+#define mutex_lock(m) EnterCriticalSection(m)
+#define mutex_unlock(m) LeaveCriticalSection(m)
+#define cond_init(c) InitializeConditionVariable(c)
+#define cond_destroy(c)
+#define cond_wait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define cond_broadcast(c) WakeAllConditionVariable(c)
+#define WORKER_RETURN unsigned __stdcall
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+#define mutex_init(m) pthread_mutex_init(m, NULL)
+#define mutex_destroy(m) pthread_mutex_destroy(m)
+#define mutex_lock(m) pthread_mutex_lock(m)
+#define mutex_unlock(m) pthread_mutex_unlock(m)
+#define cond_init(c) pthread_cond_init(c, NULL)
+#define cond_destroy(c) pthread_cond_destroy(c)
+#define cond_wait(c, m) pthread_cond_wait(c, m)
+#define cond_broadcast(c) pthread_cond_broadcast(c)
+#define WORKER_RETURN void*
+#endif
+
+/**
+ * Shared state of the worker threads. Workers sleep until the generation
+ * counter changes, then pull task indices until none are left and check in.
+ */
+struct Workers {
+	mutex_t lock;
+	cond_t work_ready, work_done;
+	thread_t* threads;
+	int num_workers, generation, num_checked_in, shutdown;
+	ThreadTask task;
+	void* args;
+	int next_task, num_tasks;
+};
+
+// pull and run tasks until the current batch is exhausted; called with lock held
+static void RunTasks(struct Workers* workers)
+{
+	while (workers->next_task < workers->num_tasks)
+	{
+		int index = workers->next_task++;
+		mutex_unlock(&workers->lock);
+		workers->task(workers->args, index);
+		mutex_lock(&workers->lock);
+	}
+}
+
+static WORKER_RETURN WorkerLoop(void* ptr)
+{
+	struct Workers* workers = ptr;
+	int seen_generation = 0;
+
+	mutex_lock(&workers->lock);
+	while (TRUE)
+	{
+		while (!workers->shutdown && workers->generation == seen_generation)
+		{
+			cond_wait(&workers->work_ready, &workers->lock);
+		}
+		if (workers->shutdown)
+		{
+			break;
+		}
+		seen_generation = workers->generation;
+
+		RunTasks(workers);
+
+		workers->num_checked_in++;
+		if (workers->num_checked_in == workers->num_workers)
+		{
+			cond_broadcast(&workers->work_done);
+		}
+	}
+	mutex_unlock(&workers->lock);
+	return 0;
+}
+
+/**
+ * Run task(args, i) for i in [0, num_tasks) across the pool, with the calling
+ * thread taking part. Returns once every task has finished.
+ */
+static void Run(struct ThreadPool* this, ThreadTask task, void* args, int num_tasks)
+{
+	struct Workers* workers = this->workers;
+	int i;
+
+	if (!workers || num_tasks <= 1)
+	{
+		for (i = 0; i < num_tasks; i++)
+		{
+			task(args, i);
+		}
+		return;
+	}
+
+	mutex_lock(&workers->lock);
+	workers->task = task;
+	workers->args = args;
+	workers->next_task = 0;
+	workers->num_tasks = num_tasks;
+	workers->num_checked_in = 0;
+	workers->generation++;
+	cond_broadcast(&workers->work_ready);
+
+	RunTasks(workers);
+
+	while (workers->num_checked_in < workers->num_workers)
+	{
+		cond_wait(&workers->work_done, &workers->lock);
+	}
+	mutex_unlock(&workers->lock);
+}
+
+static int NumCores(void)
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+#endif
+}
+
+/**
+ * Create a pool of num_threads threads (including the caller)
+ * num_threads <= 0 uses one thread per core
+ */
+static struct ThreadPool* new(int num_threads)
+{
+	struct ThreadPool* pool = malloc(sizeof(struct ThreadPool));
+	if (!pool)
+	{
+		return NULL;
+	}
+	if (num_threads <= 0)
+	{
+		num_threads = NumCores();
+	}
+	*pool = (struct ThreadPool) {
+		.num_threads = num_threads,
+		.workers = NULL,
+		.Run = &Run
+	};
+	if (num_threads == 1)
+	{
+		return pool;
+	}
+
+	struct Workers* workers = malloc(sizeof(struct Workers));
+	workers->threads = malloc((num_threads - 1) * sizeof(thread_t));
+	workers->num_workers = 0;
+	workers->generation = 0;
+	workers->num_checked_in = 0;
+	workers->shutdown = FALSE;
+	workers->task = NULL;
+	workers->args = NULL;
+	workers->next_task = 0;
+	workers->num_tasks = 0;
+	mutex_init(&workers->lock);
+	cond_init(&workers->work_ready);
+	cond_init(&workers->work_done);
+
+	int i;
+	for (i = 0; i < num_threads - 1; i++)
+	{
+#if defined(_WIN32)
+		thread_t thread = (HANDLE)_beginthreadex(NULL, 0, &WorkerLoop, workers, 0, NULL);
+		if (!thread) { break; }
+#else
+		thread_t thread;
+		if (pthread_create(&thread, NULL, &WorkerLoop, workers) != 0) { break; }
+#endif
+		workers->threads[workers->num_workers++] = thread;
+	}
+	pool->num_threads = workers->num_workers + 1;
+	pool->workers = workers;
+
+	return pool;
+}
+
+static void FreeThreadPool(struct ThreadPool* this)
+{
+	if (!this)
+	{
+		return;
+	}
+	struct Workers* workers = this->workers;
+	if (workers)
+	{
+		mutex_lock(&workers->lock);
+		workers->shutdown = TRUE;
+		cond_broadcast(&workers->work_ready);
+		mutex_unlock(&workers->lock);
+
+		int i;
+		for (i = 0; i < workers->num_workers; i++)
+		{
+#if defined(_WIN32)
+			WaitForSingleObject(workers->threads[i], INFINITE);
+			CloseHandle(workers->threads[i]);
+#else
+			pthread_join(workers->threads[i], NULL);
+#endif
+		}
+		mutex_destroy(&workers->lock);
+		cond_destroy(&workers->work_ready);
+		cond_destroy(&workers->work_done);
+		free(workers->threads);
+		free(workers);
+	}
+	free(this);
+}
+
+const struct ThreadPoolClass ThreadPool = { .new = &new, .free = &FreeThreadPool, .NumCores = &NumCores };
@@ -0,0 +1,25 @@
+#ifndef CEM_THREADPOOL_INCLUDED
+#define CEM_THREADPOOL_INCLUDED
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef void (*ThreadTask)(void* args, int index);
+
+struct ThreadPool {
+	int num_threads;
+	void* workers;
+	void (*Run)(struct ThreadPool* this, ThreadTask task, void* args, int num_tasks);
+};
+extern const struct ThreadPoolClass {
+	struct ThreadPool* (*new)(int num_threads);
+	void (*free)(struct ThreadPool* this);
+	int (*NumCores)(void);
+} ThreadPool;
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+#include <stdlib.h>
+
+#include "TransportSegments.h"
+
+// Make room for a shoreline of length cells and lay out its segments
+static void Reserve(struct TransportSegments* this, int length)
+{
+	this->num_segments = (length + SEGMENT_LENGTH - 1) / SEGMENT_LENGTH;
+	if (this->num_segments > this->segments_capacity)
+	{
+		this->entry_carried = realloc(this->entry_carried, this->num_segments * sizeof(double));
+		this->max_change = realloc(this->max_change, this->num_segments * sizeof(double));
+		this->segments_capacity = this->num_segments;
+	}
+
+	int capacity = length + 2;
+	if (capacity <= this->capacity)
+	{
+		return;
+	}
+	if (capacity < 2 * this->capacity)
+	{
+		capacity = 2 * this->capacity;
+	}
+	this->shadow_kept = realloc(this->shadow_kept, capacity * sizeof(struct ShadowEntry));
+	this->depth = realloc(this->depth, capacity * sizeof(double));
+	this->volume_available = realloc(this->volume_available, capacity * sizeof(double));
+	this->flow_dir = realloc(this->flow_dir, capacity * sizeof(FLOW_DIR));
+	this->carried = realloc(this->carried, capacity * sizeof(double));
+	this->limited_prev = realloc(this->limited_prev, capacity * sizeof(double));
+	this->capacity = capacity;
+}
+
+/**
+ * Segments run on a pool of num_threads threads (including the caller),
+ * < 0 for one thread per core. No pool for 0 or 1, so the engine stays serial.
+ */
+static struct TransportSegments new(int num_threads)
+{
+	return (struct TransportSegments) {
+		.pool = (num_threads == 0 || num_threads == 1) ? NULL : ThreadPool.new(num_threads < 0 ? 0 : num_threads),
+		.num_segments = 0,
+		.capacity = 0,
+		.segments_capacity = 0,
+		.shadow_kept = NULL,
+		.depth = NULL,
+		.volume_available = NULL,
+		.flow_dir = NULL,
+		.carried = NULL,
+		.limited_prev = NULL,
+		.entry_carried = NULL,
+		.max_change = NULL,
+		.Reserve = &Reserve
+	};
+}
+
+static void FreeTransportSegments(struct TransportSegments* this)
+{
+	ThreadPool.free(this->pool);
+	free(this->shadow_kept);
+	free(this->depth);
+	free(this->volume_available);
+	free(this->flow_dir);
+	free(this->carried);
+	free(this->limited_prev);
+	free(this->entry_carried);
+	free(this->max_change);
+	*this = new(0);
+}
+
+const struct TransportSegmentsClass TransportSegments = { .new = &new, .free = &FreeTransportSegments };
@@ -0,0 +1,44 @@
+#ifndef CEM_TRANSPORTSEGMENTS_INCLUDED
+#define CEM_TRANSPORTSEGMENTS_INCLUDED
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "consts.h"
+#include "BeachGrid.h"
+#include "ThreadPool.h"
+
+#define SEGMENT_LENGTH 512        /* shoreline cells per segment */
+#define SEGMENT_HALO 8            /* cells a segment limits ahead of its start to guess the potential it enters with */
+
+/**
+ * The arrays engine's shoreline cut into contiguous segments of
+ * SEGMENT_LENGTH cells, whose transport phases run on a thread pool, see
+ * WaveTransformationSegments. The segments only depend on the shoreline's
+ * length, never on the number of threads. The arrays hold what the
+ * phases hand each other, by shoreline position as in struct Shoreline.
+ */
+struct TransportSegments {
+	struct ThreadPool* pool;
+	int num_segments, capacity, segments_capacity;
+	struct ShadowEntry* shadow_kept;  /* threshold to keep in the shadow cache, key EMPTY_INT if none */
+	double* depth;                /* depth of closure */
+	double* volume_available;
+	FLOW_DIR* flow_dir;
+	double* carried;              /* transport_potential[i] once cell i limited it, as cell i + 1 sees it */
+	double* limited_prev;         /* transport_potential[i - 1] once cell i limited it, its final value */
+	double* entry_carried;        /* per segment, carried potential its halo ended with */
+	double* max_change;           /* per segment, largest change of frac_full of its cells */
+	void (*Reserve)(struct TransportSegments* this, int length);
+};
+extern const struct TransportSegmentsClass {
+	struct TransportSegments (*new)(int num_threads);
+	void (*free)(struct TransportSegments* this);
+} TransportSegments;
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -2,6 +2,10 @@
 #include "WaveClimate.h"
 #include <math.h>
 
+/* Condensed series: angle bins across the half plane facing the coast, as in the original CEM, and height classes */
+#define DEFAULT_ANGLE_BINS 36
+#define DEFAULT_HEIGHT_BINS 4
+
 static double GetWaveHeight(struct WaveClimate* this, int timestep)
 {
 	return this->wave_heights[(int)floor(timestep / this->t_resolution)];
@@ -12,26 +16,65 @@ static double GetWavePeriod(struct WaveClimate* this, int timestep)
 	return this->wave_periods[(int)floor(timestep / this->t_resolution)];
 }
 
+static int IsStochastic(const struct WaveClimate* this)
+{
+	return this->asymmetry >= 0 && this->stability >= 0;
+}
+
+/**
+ * Random wave angle of a timestep, drawn from the (seed, timestep) counter
+ * so any step of the sequence can be computed independently
+ */
+static double GetStochasticAngle(const struct WaveClimate* this, int timestep)
+{
+	uint32_t counter[4] = { (uint32_t)timestep, 0, 0, 0 };
+	uint32_t key[2] = { this->seed, 0 };
+	uint32_t words[4];
+	Philox4x32(counter, key, words);
+
+	double angle = RandWordToUnit(words[0]) * (PI / 4);   // random angle 0 - pi/4
+	if (RandWordToUnit(words[1]) >= this->stability)        // random variable determining above or below 45 degrees
+	{
+		angle += PI / 4;
+	}
+	if (RandWordToUnit(words[2]) >= this->asymmetry)        // random variable determining direction of approach (positive = left)
+	{
+		angle = -angle;
+	}
+	return angle;
+}
+
+// pre-generate the random angle of every timestep in one pass
+static double* GenerateStochasticAngles(const struct WaveClimate* this)
+{
+	if (!IsStochastic(this) || this->num_timesteps <= 0)
+	{
+		return NULL;
+	}
+	double* angles = malloc(this->num_timesteps * sizeof(double));
+	int t;
+	for (t = 0; t < this->num_timesteps; t++)
+	{
+		angles[t] = GetStochasticAngle(this, t);
+	}
+	return angles;
+}
+
 static double GetWaveAngle(struct WaveClimate* this, int timestep)
 {
-	if (this->asymmetry >= 0 && this->stability >= 0)
+	if (IsStochastic(this))
 	{
-		double angle = RandZeroToOne() * (PI / 4);   // random angle 0 - pi/4
-		if (RandZeroToOne() >= this->stability)        // random variable determining above or below 45 degrees
+		if (this->stochastic_angles && timestep >= 0 && timestep < this->num_timesteps)
 		{
-			angle += PI / 4;
+			return this->stochastic_angles[timestep];
 		}
-		if (RandZeroToOne() >= this->asymmetry)        // random variable determining direction of approach (positive = left)
-		{
-			angle = -angle;
-		}
-		return angle;
+		return GetStochasticAngle(this, timestep);
 	}
 
 	return this->wave_angles[(int)floor(timestep / this->t_resolution)];
 }
 
-static struct WaveClimate new(double* wave_periods, double* wave_angles, double* wave_heights, double asymmetry, double stability, int num_timesteps, int num_wave_inputs) {
+static struct WaveClimate new(double* wave_periods, double* wave_angles, double* wave_heights, double asymmetry, double stability, int num_timesteps, int num_wave_inputs, unsigned int seed) {
 
 	double* periods = malloc(num_wave_inputs * sizeof(double));
 	double* heights = malloc(num_wave_inputs * sizeof(double));
@@ -46,17 +89,236 @@ static struct WaveClimate new(double* wave_periods, double* wave_angles, double*
 
 	double t_resolution = ((double)num_timesteps) / num_wave_inputs;
 
-	return (struct WaveClimate) {
+	struct WaveClimate climate = {
 		.t_resolution = t_resolution,
 		.wave_periods = periods,
 		.wave_angles = angles,
 		.wave_heights = heights,
 		.asymmetry = asymmetry,
 		.stability = stability,
+		.seed = seed,
+		.num_timesteps = num_timesteps,
+		.owns_arrays = TRUE,
+		.stochastic_angles = NULL,
+		.num_conditions = 0,
+		.morphological_factor = 0,
+		.num_slots = 0,
+		.weights = NULL,
+		.schedule = NULL,
 		.GetWaveHeight = &GetWaveHeight,
 		.GetWavePeriod = &GetWavePeriod,
 		.GetWaveAngle = &GetWaveAngle
 	};
+	climate.stochastic_angles = GenerateStochasticAngles(&climate);
+	return climate;
+}
+
+/**
+ * Wave climate reading the input arrays of source without copying them,
+ * with its own random stream. Must not outlive source.
+ */
+static struct WaveClimate share(const struct WaveClimate* source, unsigned int seed)
+{
+	struct WaveClimate climate = *source;
+	climate.seed = seed;
+	climate.owns_arrays = FALSE;
+	climate.stochastic_angles = GenerateStochasticAngles(&climate);
+	return climate;
+}
+
+static void FreeWaveClimate(struct WaveClimate* this)
+{
+	free(this->stochastic_angles);
+	this->stochastic_angles = NULL;
+	if (!this->owns_arrays)
+	{
+		return;
+	}
+	free(this->wave_periods);
+	free(this->wave_angles);
+	free(this->wave_heights);
+	free(this->weights);
+	free(this->schedule);
+	this->wave_periods = NULL;
+	this->wave_angles = NULL;
+	this->wave_heights = NULL;
+	this->weights = NULL;
+	this->schedule = NULL;
+}
+
+// Schedule slot of a timestep, timesteps past the series keep its last slot
+static int GetSlot(const struct WaveClimate* this, int timestep)
+{
+	int slot = timestep > 0 ? timestep / this->morphological_factor : 0;
+	return slot < this->num_slots ? slot : this->num_slots - 1;
+}
+
+static double GetCondensedWaveHeight(struct WaveClimate* this, int timestep)
+{
+	return this->wave_heights[this->schedule[GetSlot(this, timestep)]];
+}
+
+static double GetCondensedWavePeriod(struct WaveClimate* this, int timestep)
+{
+	return this->wave_periods[this->schedule[GetSlot(this, timestep)]];
+}
+
+static double GetCondensedWaveAngle(struct WaveClimate* this, int timestep)
+{
+	return this->wave_angles[this->schedule[GetSlot(this, timestep)]];
+}
+
+/* Sums over the timesteps of one (angle bin, height class) */
+struct WaveClass {
+	int count;
+	double transport;       /* sum of H^12/5 T^1/5 */
+	double height;          /* sum of H^12/5 */
+	double angle, period;   /* plain sums, for classes without transport */
+	double weighted_angle;  /* sum of angle H^12/5 T^1/5 */
+};
+
+/**
+ * Condense the wave series into representative conditions, binning every
+ * timestep's wave (the stochastic angle if any) by angle, in num_angle_bins
+ * (<= 0 for DEFAULT_ANGLE_BINS) bins across the half plane facing the
+ * coast and as wide behind it, and by height, in num_height_bins (<= 0 for
+ * DEFAULT_HEIGHT_BINS) classes between the lowest and highest wave. Each
+ * class's condition keeps its mean deep water transport, which goes as
+ * H^12/5 T^1/5: the height from the mean H^12/5, the period from the mean
+ * H^12/5 T^1/5 and the angle weighted by it. Its weight is the fraction of
+ * timesteps in the class.
+ *
+ * Every morphological_factor timesteps make a slot, and the slots break the
+ * conditions in proportion to their weights, each one as evenly spread over
+ * the run as the others allow (the condition furthest behind its share
+ * takes the next slot). The series' order is lost, only its statistics stay.
+ * RETURN: 0 on success (nothing to do for a factor <= 1), -1 if this is left as it was
+ */
+static int Condense(struct WaveClimate* this, int num_angle_bins, int num_height_bins, int morphological_factor)
+{
+	if (morphological_factor <= 1)
+	{
+		return 0;
+	}
+	int n = this->num_timesteps;
+	if (n <= 0)
+	{
+		return -1;
+	}
+	num_angle_bins = num_angle_bins > 0 ? num_angle_bins : DEFAULT_ANGLE_BINS;
+	num_height_bins = num_height_bins > 0 ? num_height_bins : DEFAULT_HEIGHT_BINS;
+
+	int t;
+	double min_height = HUGE_VAL, max_height = -HUGE_VAL;
+	for (t = 0; t < n; t++)
+	{
+		double height = this->GetWaveHeight(this, t);
+		min_height = fmin(min_height, height);
+		max_height = fmax(max_height, height);
+	}
+
+	int num_classes = 2 * num_angle_bins * num_height_bins;
+	int num_slots = (n + morphological_factor - 1) / morphological_factor;
+	struct WaveClass* classes = calloc(num_classes, sizeof(struct WaveClass));
+	double* periods = malloc(num_classes * sizeof(double));
+	double* angles = malloc(num_classes * sizeof(double));
+	double* heights = malloc(num_classes * sizeof(double));
+	double* weights = malloc(num_classes * sizeof(double));
+	int* schedule = malloc(num_slots * sizeof(int));
+	double* credit = calloc(num_classes, sizeof(double));
+	if (!classes || !periods || !angles || !heights || !weights || !schedule || !credit)
+	{
+		free(classes);
+		free(credit);
+		free(periods);
+		free(angles);
+		free(heights);
+		free(weights);
+		free(schedule);
+		return -1;
+	}
+
+	double bin_width = PI / num_angle_bins;
+	for (t = 0; t < n; t++)
+	{
+		double height = this->GetWaveHeight(this, t);
+		double period = this->GetWavePeriod(this, t);
+		double angle = this->GetWaveAngle(this, t);
+		angle -= 2 * PI * floor((angle + PI) / (2 * PI));   // into [-PI, PI)
+
+		int a = (int)((angle + PI) / bin_width);
+		a = a < 2 * num_angle_bins ? a : 2 * num_angle_bins - 1;
+		int h = max_height > min_height ? (int)((height - min_height) / (max_height - min_height) * num_height_bins) : 0;
+		h = h < num_height_bins ? h : num_height_bins - 1;
+
+		struct WaveClass* wave_class = &classes[a * num_height_bins + h];
+		double height_factor = pow(height, 12.0 / 5.0);
+		double transport = height_factor * pow(period, 1.0 / 5.0);
+		wave_class->count++;
+		wave_class->transport += transport;
+		wave_class->height += height_factor;
+		wave_class->angle += angle;
+		wave_class->period += period;
+		wave_class->weighted_angle += angle * transport;
+	}
+
+	int i, num_conditions = 0;
+	for (i = 0; i < num_classes; i++)
+	{
+		struct WaveClass* wave_class = &classes[i];
+		if (wave_class->count == 0)
+		{
+			continue;
+		}
+		if (wave_class->transport > 0)
+		{
+			heights[num_conditions] = pow(wave_class->height / wave_class->count, 5.0 / 12.0);
+			periods[num_conditions] = pow(wave_class->transport / wave_class->height, 5.0);
+			angles[num_conditions] = wave_class->weighted_angle / wave_class->transport;
+		}
+		else
+		{
+			heights[num_conditions] = 0.0;
+			periods[num_conditions] = wave_class->period / wave_class->count;
+			angles[num_conditions] = wave_class->angle / wave_class->count;
+		}
+		weights[num_conditions] = (double)wave_class->count / n;
+		num_conditions++;
+	}
+
+	// a condition's credit is its share of the slots so far less the slots it took
+	int slot;
+	for (slot = 0; slot < num_slots; slot++)
+	{
+		int next = 0;
+		for (i = 0; i < num_conditions; i++)
+		{
+			credit[i] += weights[i];
+			if (credit[i] > credit[next])
+			{
+				next = i;
+			}
+		}
+		credit[next] -= 1.0;
+		schedule[slot] = next;
+	}
+	free(classes);
+	free(credit);
+
+	FreeWaveClimate(this);
+	this->wave_periods = periods;
+	this->wave_angles = angles;
+	this->wave_heights = heights;
+	this->weights = weights;
+	this->schedule = schedule;
+	this->owns_arrays = TRUE;
+	this->num_conditions = num_conditions;
+	this->morphological_factor = morphological_factor;
+	this->num_slots = num_slots;
+	this->GetWaveHeight = &GetCondensedWaveHeight;
+	this->GetWavePeriod = &GetCondensedWavePeriod;
+	this->GetWaveAngle = &GetCondensedWaveAngle;
+	return 0;
 }
 
-const struct WaveClimateClass WaveClimate = { .new = &new };
+const struct WaveClimateClass WaveClimate = { .new = &new, .share = &share, .condense = &Condense, .free = &FreeWaveClimate };
@@ -10,16 +10,27 @@ extern "C" {
 	struct WaveClimate {
 		double t_resolution;
 		double asymmetry, stability;
+		unsigned int seed;
+		int num_timesteps, owns_arrays;
+		double* stochastic_angles;
 		double* wave_periods;
 		double* wave_angles;
 		double* wave_heights;
+		/* condensed: the input arrays hold num_conditions representative conditions, each timestep breaks
+		   the one scheduled for its slot of morphological_factor timesteps (0 if not condensed) */
+		int num_conditions, morphological_factor, num_slots;
+		double* weights;            /* condensed: fraction of the series' timesteps each condition stands for */
+		int* schedule;              /* condensed: condition of each slot */
 		double (*GetWaveHeight)(struct WaveClimate *this, int timestep);
 		double (*GetWavePeriod)(struct WaveClimate* this, int timestep);
 		double (*GetWaveAngle)(struct WaveClimate* this, int timestep);
 	};
 	extern const struct WaveClimateClass {
 		struct WaveClimate(*new)(double* wave_periods, double* wave_angles, double* wave_heights, 
-			double asymmetry, double stability, int num_timesteps, int numWaveInputs);
+			double asymmetry, double stability, int num_timesteps, int numWaveInputs, unsigned int seed);
+		struct WaveClimate(*share)(const struct WaveClimate* source, unsigned int seed);
+		int (*condense)(struct WaveClimate* this, int num_angle_bins, int num_height_bins, int morphological_factor);
+		void (*free)(struct WaveClimate* this);
 	} WaveClimate;
 
 #endif
\ No newline at end of file
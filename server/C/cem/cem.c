@@ -2,164 +2,409 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+#include "cem.h"
+#include "CemModel.h"
 #include "consts.h"
 #include "BeachGrid.h"
 #include "BeachNode.h"
 #include "WaveClimate.h"
+#include "Shoreline.h"
+#include "Refraction.h"
+#include "ClosureDepth.h"
+#include "TransportSegments.h"
+#include "ImplicitTransport.h"
 #include "sedtrans.h"
 #include "utils.h"
 #include "config.h"
 
 
-/* Globals */
-struct BeachGrid g_beachGrid;
-int current_time_step;
-double current_time;
-
-/* Wave climate object */
-struct WaveClimate g_wave_climate;
-
-/* Config parameter */
-Config myConfig;
+/* Adaptive timestep: largest change of frac_full a step aims for by default, and most substeps per timestep */
+#define DEFAULT_MAX_CELL_CHANGE 0.1
+#define MAX_SUBSTEPS 32
 
 /* Functions */
-void InitializeBeachGrid();
-void SedimentTransport();
-
-/* Main steps */
-int cem_initialize(Config config);
-double* cem_update(int saveInterval);
-int cem_finalize(void);
+void InitializeBeachGrid(CemModel* model);
+int SedimentTransport(CemModel* model, double timestep_length, double* max_change);
+int SedimentTransportArrays(CemModel* model, double timestep_length, double* max_change);
+static int StepAdaptively(CemModel* model, int numSteps);
+static int StepAccelerated(CemModel* model, int numSteps);
+static double GetStepLimit(CemModel* model);
+static int IsSameWave(CemModel* model, int t1, int t2);
 
 /* Logging and Debugging */
-void SaveOutputGrid();
-double* outputGrid;
-void test_LogShoreline();
-void test_OutputGrid();
+void SaveOutputGrid(CemModel* model);
+void test_LogShoreline(CemModel* model);
+void test_OutputGrid(CemModel* model);
 
 // TODO: Add error and data return
-int cem_initialize(Config config)
+CemModel* cem_create(Config config)
 {
-	srand(time(NULL));
-	current_time_step = 0;
-	current_time = 0.0;
+	return CreateModel(config, NULL, (unsigned int)time(NULL));
+}
 
-	myConfig = config;
-	g_wave_climate = WaveClimate.new(myConfig.wavePeriods, myConfig.waveAngles, myConfig.waveHeights,
-		myConfig.asymmetry, myConfig.stability, myConfig.numTimesteps, myConfig.numWaveInputs);
+// Create a model whose stochastic wave angles are reproducible from seed
+CemModel* cem_create_seeded(Config config, unsigned int seed)
+{
+	return CreateModel(config, NULL, seed);
+}
 
-	InitializeBeachGrid();
+/**
+ * Create a model, optionally reading its wave inputs from an existing
+ * climate instead of copying them (used by ensemble members)
+ */
+CemModel* CreateModel(Config config, const struct WaveClimate* shared_waves, unsigned int seed)
+{
+	CemModel* model = malloc(sizeof(CemModel));
+	if (!model)
+	{
+		return NULL;
+	}
+	model->current_time_step = 0;
+	model->current_time = 0.0;
+	model->cell_change_rate = 0.0;
+	model->shoreline = Shoreline.new();
+	model->refraction = Refraction.new(config.refraction, config.breakingTolerance);
+	model->closure_depth = ClosureDepth.new(config);
+	model->segments = TransportSegments.new(config.engine == ENGINE_ARRAYS ? config.transportThreads : 0);
+	model->implicit = ImplicitTransport.new();
+
+	model->config = config;
+	if (shared_waves)
+	{
+		model->wave_climate = WaveClimate.share(shared_waves, seed);
+	}
+	else
+	{
+		model->wave_climate = WaveClimate.new(config.wavePeriods, config.waveAngles, config.waveHeights,
+			config.asymmetry, config.stability, config.numTimesteps, config.numWaveInputs, seed);
+	}
+
+	InitializeBeachGrid(model);
+	model->output_grid = malloc(config.nRows * config.nCols * sizeof(double));
+
+	// a model that failed to condense would run the full series unaccelerated
+	if (!model->output_grid
+		|| WaveClimate.condense(&model->wave_climate, config.waveAngleBins, config.waveHeightBins, config.morphologicalFactor) != 0
+		|| model->grid.FindBeach(&model->grid) < 0)
+	{
+		cem_destroy(model);
+		return NULL;
+	}
+
+	return model;
+}
+
+// Update the CEM by given steps, returning a row-major copy of the grid, NULL if a step failed
+double* cem_update(CemModel* model, int saveInterval) {
+	if (cem_step(model, saveInterval) != 0)
+	{
+		return NULL;
+	}
+
+	SaveOutputGrid(model);
+	//test_OutputGrid(model);
+	//test_LogShoreline(model);
+	return model->output_grid;
+}
 
- 	if (g_beachGrid.FindBeach(&g_beachGrid) < 0)
+/**
+ * Update the CEM by given steps without copying the grid out
+ * RETURN: 0 on success, -1 if the shoreline was lost, after which the
+ *   model only fails
+ */
+int cem_step(CemModel* model, int numSteps) {
+	if (!model || !model->grid.shoreline)
 	{
 		return -1;
 	}
-	outputGrid = malloc(myConfig.nRows * myConfig.nCols * sizeof(double));
+	if (model->wave_climate.morphological_factor > 1)
+	{
+		return StepAccelerated(model, numSteps);
+	}
+	if (model->config.adaptiveTimestep)
+	{
+		return StepAdaptively(model, numSteps);
+	}
+	int i;
+	for (i = 0; i < numSteps; i++)
+	{
+		double change;
+		model->grid.current_time = model->current_time_step;
+		if (SedimentTransport(model, model->config.lengthTimestep, &change) != 0)
+		{
+			return -1;
+		}
+		model->current_time_step++;
+		model->current_time += model->config.lengthTimestep;
+	}
+	return 0;
+}
+
+// Longest transport step (days) keeping frac_full changes within maxCellChange at the last step's rate
+static double GetStepLimit(CemModel* model)
+{
+	double max_change = model->config.maxCellChange > 0 ? model->config.maxCellChange : DEFAULT_MAX_CELL_CHANGE;
+	return model->cell_change_rate > 0 ? max_change / model->cell_change_rate : HUGE_VAL;
+}
+
+/**
+ * Advance numSteps timesteps in transport steps sized so no cell's frac_full
+ * changes by more than maxCellChange, going by the largest change per day of
+ * the last transport step. A step that would is split into up to
+ * MAX_SUBSTEPS. Otherwise the timesteps ahead with the wave the rate was
+ * measured with merge into one step, up to the end of numSteps.
+ * RETURN: 0 on success, -1 if a transport step failed
+ */
+static int StepAdaptively(CemModel* model, int numSteps)
+{
+	Config* config = &model->config;
+	int end = model->current_time_step + numSteps;
+
+	while (model->current_time_step < end)
+	{
+		int t = model->current_time_step;
+		double step_limit = GetStepLimit(model);
+		int steps = 1;
+		int substeps = 1;
+		if (step_limit < config->lengthTimestep)
+		{
+			substeps = (int)ceil(config->lengthTimestep / step_limit);
+			substeps = substeps < MAX_SUBSTEPS ? substeps : MAX_SUBSTEPS;
+		}
+		else if (t > 0 && IsSameWave(model, t - 1, t))
+		{
+			int max_steps = step_limit < (end - t) * config->lengthTimestep ? (int)(step_limit / config->lengthTimestep) : end - t;
+			while (steps < max_steps && IsSameWave(model, t, t + steps))
+			{
+				steps++;
+			}
+		}
 
+		double timestep_length = steps * config->lengthTimestep / substeps;
+		double change = 0.0;
+		int i;
+		for (i = 0; i < substeps; i++)
+		{
+			// the grid's clock tells shoreline steps apart, so it counts substeps as well
+			double step_change;
+			model->grid.current_time++;
+			if (SedimentTransport(model, timestep_length, &step_change) != 0)
+			{
+				return -1;
+			}
+			change = fmax(change, step_change);
+		}
+		model->cell_change_rate = change / timestep_length;
+		model->current_time_step += steps;
+		model->current_time += steps * config->lengthTimestep;
+	}
 	return 0;
 }
 
-// Update the CEM by given steps
-double* cem_update(int saveInterval) {
-	int i;
-	for (i = 0; i < saveInterval; i++)
+/**
+ * Advance numSteps timesteps over the condensed wave climate, one transport
+ * step per slot of morphological_factor timesteps, so each step moves the
+ * sand of its whole slot. A slot cut by the end of numSteps is finished by
+ * the next call with the same wave. With adaptiveTimestep a step that would
+ * change a cell by more than maxCellChange is split as in StepAdaptively.
+ * RETURN: 0 on success, -1 if a transport step failed
+ */
+static int StepAccelerated(CemModel* model, int numSteps)
+{
+	Config* config = &model->config;
+	int factor = model->wave_climate.morphological_factor;
+	int end = model->current_time_step + numSteps;
+
+	while (model->current_time_step < end)
 	{
-		g_beachGrid.current_time = current_time_step;
-		SedimentTransport();
-		current_time_step++;
-		current_time += myConfig.lengthTimestep;
+		int t = model->current_time_step;
+		int slot_end = (t / factor + 1) * factor;
+		int steps = (slot_end < end ? slot_end : end) - t;
+
+		double step_limit = config->adaptiveTimestep ? GetStepLimit(model) : HUGE_VAL;
+		int substeps = 1;
+		if (step_limit < steps * config->lengthTimestep)
+		{
+			substeps = (int)ceil(steps * config->lengthTimestep / step_limit);
+			substeps = substeps < MAX_SUBSTEPS ? substeps : MAX_SUBSTEPS;
+		}
+
+		double timestep_length = steps * config->lengthTimestep / substeps;
+		double change = 0.0;
+		int i;
+		for (i = 0; i < substeps; i++)
+		{
+			double step_change;
+			model->grid.current_time++;
+			if (SedimentTransport(model, timestep_length, &step_change) != 0)
+			{
+				return -1;
+			}
+			change = fmax(change, step_change);
+		}
+		model->cell_change_rate = change / timestep_length;
+		model->current_time_step += steps;
+		model->current_time += steps * config->lengthTimestep;
 	}
+	return 0;
+}
+
+// Whether timesteps t1 and t2 break the same wave
+static int IsSameWave(CemModel* model, int t1, int t2)
+{
+	struct WaveClimate* wave_climate = &model->wave_climate;
+	return wave_climate->GetWaveAngle(wave_climate, t1) == wave_climate->GetWaveAngle(wave_climate, t2)
+		&& wave_climate->GetWavePeriod(wave_climate, t1) == wave_climate->GetWavePeriod(wave_climate, t2)
+		&& wave_climate->GetWaveHeight(wave_climate, t1) == wave_climate->GetWaveHeight(wave_climate, t2);
+}
 
-	SaveOutputGrid();
-	//test_OutputGrid();
-	//test_LogShoreline();
-	return outputGrid;
+/**
+ * Point at the model's own raster instead of copying it. The view stays
+ * valid until cem_destroy and reflects every later cem_step.
+ */
+CemRaster cem_get_raster(const CemModel* model) {
+	return (CemRaster) {
+		.data = model->grid.frac_full[0],
+		.nRows = model->grid.rows,
+		.nCols = model->grid.cols,
+		.rowStride = model->grid.rows > 1 ? (int)(model->grid.frac_full[1] - model->grid.frac_full[0]) : model->grid.cols
+	};
 }
 
-int cem_finalize() {
+int cem_destroy(CemModel* model) {
+	if (!model)
+	{
+		return -1;
+	}
 	// free everything
-	g_beachGrid.FreeShoreline(&g_beachGrid);
-	struct BeachNode** cells = g_beachGrid.cells;
-	free2d(cells);
-	free(outputGrid);
+	BeachGrid.free(&model->grid);
+	WaveClimate.free(&model->wave_climate);
+	Shoreline.free(&model->shoreline);
+	Refraction.free(&model->refraction);
+	ClosureDepth.free(&model->closure_depth);
+	TransportSegments.free(&model->segments);
+	ImplicitTransport.free(&model->implicit);
+	free(model->output_grid);
+	free(model);
 	return 0;
 }
 
 /* -----MAIN FUNCTIONS---- */
 
-void InitializeBeachGrid()
+void InitializeBeachGrid(CemModel* model)
 {
-	g_beachGrid = BeachGrid.new(myConfig.nRows, myConfig.nCols, myConfig.cellWidth, myConfig.cellLength);
-	struct BeachNode** nodes = (struct BeachNode**)malloc2d(myConfig.nRows, myConfig.nCols, sizeof(struct BeachNode));
+	Config* config = &model->config;
+	model->grid = BeachGrid.new(config->nRows, config->nCols, config->cellWidth, config->cellLength);
+	model->grid.transport_cache.is_active = config->incremental;
+	model->grid.transport_cache.tolerance = config->incrementalTolerance;
 
 	int r, c;
-	for (r = 0; r < myConfig.nRows; r++)
+	for (r = 0; r < config->nRows; r++)
 	{
-		for (c = 0; c < myConfig.nCols; c++)
+		for (c = 0; c < config->nCols; c++)
 		{
-			double val = myConfig.grid[r][c];
-			nodes[r][c] = BeachNode.new(val, r, c);
+			model->grid.frac_full[r][c] = config->grid[r][c];
 		}
 	}
+}
 
-	g_beachGrid.SetCells(&g_beachGrid, nodes);
+/**
+ * One transport step of timestep_length days
+ * OUTPUT: max_change - largest change of frac_full of a shoreline cell
+ * RETURN: 0 on success, -1 if FixBeach lost the shoreline
+ */
+int SedimentTransport(CemModel* model, double timestep_length, double* max_change)
+{
+	Config* config = &model->config;
+	struct BeachGrid* grid = &model->grid;
+	struct WaveClimate* wave_climate = &model->wave_climate;
+	int t = model->current_time_step;
+
+	if (config->engine == ENGINE_ARRAYS)
+	{
+		return SedimentTransportArrays(model, timestep_length, max_change);
+	}
+
+	(*grid).SetShorelineAngles(grid);
+	WaveTransformation(grid, &model->refraction,
+		wave_climate->GetWaveAngle(wave_climate, t),
+		wave_climate->GetWavePeriod(wave_climate, t),
+		wave_climate->GetWaveHeight(wave_climate, t),
+		timestep_length, config->sedMobility);
+
+	*max_change = SedimentBudget(grid, &model->closure_depth);
+
+	return FixBeach(grid);
 }
 
-void SedimentTransport()
+// Transport phases over the shoreline arrays, by segment with a pool or implicitly, FixBeach on the relinked grid
+int SedimentTransportArrays(CemModel* model, double timestep_length, double* max_change)
 {
-	WaveTransformation(&g_beachGrid,
-		g_wave_climate.GetWaveAngle(&g_wave_climate, current_time_step),
-		g_wave_climate.GetWavePeriod(&g_wave_climate, current_time_step),
-		g_wave_climate.GetWaveHeight(&g_wave_climate, current_time_step),
-		myConfig.lengthTimestep, myConfig.sedMobility);
-
-	GetAvailableSupply(&g_beachGrid,
-		myConfig.crossShoreReferencePos,
-		myConfig.shelfDepthAtReferencePos,
-		myConfig.shelfSlope,
-		myConfig.shorefaceSlope,
-		myConfig.minimumShelfDepthAtClosure,
-		myConfig.depthOfClosure);
-	NetVolumeChange(&g_beachGrid);
-
-	TransportSediment(&g_beachGrid,
-		myConfig.crossShoreReferencePos,
-		myConfig.shelfDepthAtReferencePos,
-		myConfig.shelfSlope,
-		myConfig.shorefaceSlope,
-		myConfig.minimumShelfDepthAtClosure,
-		myConfig.depthOfClosure);
-
-	FixBeach(&g_beachGrid);
+	Config* config = &model->config;
+	struct BeachGrid* grid = &model->grid;
+	struct WaveClimate* wave_climate = &model->wave_climate;
+	struct Shoreline* shoreline = &model->shoreline;
+	struct TransportSegments* segments = &model->segments;
+	int t = model->current_time_step;
+	double wave_angle = wave_climate->GetWaveAngle(wave_climate, t);
+
+	shoreline->Load(shoreline, grid);
+
+	if (segments->pool)
+	{
+		WaveTransformationSegments(shoreline, grid, &model->refraction, segments,
+			wave_angle,
+			wave_climate->GetWavePeriod(wave_climate, t),
+			wave_climate->GetWaveHeight(wave_climate, t),
+			timestep_length, config->sedMobility);
+	}
+	else
+	{
+		WaveTransformationArrays(shoreline, grid, &model->refraction,
+			wave_angle,
+			wave_climate->GetWavePeriod(wave_climate, t),
+			wave_climate->GetWaveHeight(wave_climate, t),
+			timestep_length, config->sedMobility);
+	}
+
+	int is_solved = config->implicitTransport && SedimentBudgetImplicit(shoreline, grid, &model->closure_depth, &model->refraction,
+		&model->implicit, wave_angle, timestep_length, config->sedMobility, max_change) == 0;
+	if (!is_solved && segments->pool)
+	{
+		*max_change = SedimentBudgetSegments(shoreline, grid, &model->closure_depth, segments);
+	}
+	else if (!is_solved)
+	{
+		*max_change = SedimentBudgetArrays(shoreline, grid, &model->closure_depth);
+	}
+	shoreline->Store(shoreline);
+
+	return FixBeach(grid);
 }
 
 /* ----- CONFIGURATION AND OUTPUT FUNCTIONS -----*/
-void SaveOutputGrid()
+void SaveOutputGrid(CemModel* model)
 {
 	int r, c;
-	for (r = 0; r < myConfig.nRows; r++)
+	for (r = 0; r < model->config.nRows; r++)
 	{
-		for (c = 0; c < myConfig.nCols; c++)
+		for (c = 0; c < model->config.nCols; c++)
 		{
-			struct BeachNode* node = g_beachGrid.TryGetNode(&g_beachGrid, r, c);
-			if (!node)
-			{
-				continue;
-			}
-			int i = r * myConfig.nCols + c;
-			outputGrid[i] = node->frac_full;
+			int i = r * model->config.nCols + c;
+			model->output_grid[i] = model->grid.frac_full[r][c];
 		}
 	}
 }
 
-void test_LogShoreline() {
+void test_LogShoreline(CemModel* model) {
 	char savefile_name[50];
-	sprintf(savefile_name, "test/output/new/shoreline%06d.out", current_time_step - 1);
+	sprintf(savefile_name, "test/output/new/shoreline%06d.out", model->current_time_step - 1);
 
 	FILE* savefile = fopen(savefile_name, "w");
 
-	struct BeachNode* curr = g_beachGrid.shoreline;
+	struct BeachNode* curr = model->grid.shoreline;
 	while (!curr->is_boundary)
 	{
 		fprintf(savefile, " %d,%d\n", curr->row, curr->col);
@@ -169,23 +414,17 @@ void test_LogShoreline() {
 	fclose(savefile);
 }
 
-void test_OutputGrid() {
+void test_OutputGrid(CemModel* model) {
 	char savefile_name[40];
-	sprintf(savefile_name, "test/output/new/CEM_%06d.out", current_time_step-1);
-	
+	sprintf(savefile_name, "test/output/new/CEM_%06d.out", model->current_time_step - 1);
+
 	FILE* savefile = fopen(savefile_name, "w");
 	int r, c;
-	for (r = 0; r < myConfig.nRows; r++)
+	for (r = 0; r < model->config.nRows; r++)
 	{
-		for (c = 0; c < myConfig.nCols; c++)
+		for (c = 0; c < model->config.nCols; c++)
 		{
-			struct BeachNode* node = g_beachGrid.TryGetNode(&g_beachGrid, r, c);
-			if (!node)
-			{
-				fprintf(savefile, " --");
-				continue;
-			}
-			fprintf(savefile, " %lf", node->frac_full);
+			fprintf(savefile, " %lf", model->grid.frac_full[r][c]);
 		}
 		fprintf(savefile, "\n");
 	}
@@ -0,0 +1,48 @@
+#ifndef CEM_MODEL_INCLUDED
+#define CEM_MODEL_INCLUDED
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "py_interface/cem_EXPORTS.h"
+#include "config.h"
+
+/* Opaque model handle: owns the grid, wave climate and time counters of one run */
+typedef struct CemModel CemModel;
+
+/* Open checkpoint journal: a full checkpoint followed by per-append deltas */
+typedef struct CemJournal CemJournal;
+
+/* Live view of a model's frac_full raster: cell (r, c) is data[r * rowStride + c] */
+typedef struct CemRaster {
+	double* data;
+	int nRows, nCols, rowStride;
+} CemRaster;
+
+cem_EXPORT CemModel* cem_create(Config config);
+cem_EXPORT CemModel* cem_create_seeded(Config config, unsigned int seed);
+cem_EXPORT double* cem_update(CemModel* model, int saveInterval);
+cem_EXPORT int cem_step(CemModel* model, int numSteps);
+cem_EXPORT CemRaster cem_get_raster(const CemModel* model);
+cem_EXPORT int cem_destroy(CemModel* model);
+
+/* Binary snapshot of the full model state, see checkpoint.c */
+cem_EXPORT int cem_save_checkpoint(const CemModel* model, const char* path);
+cem_EXPORT CemModel* cem_load_checkpoint(Config config, const char* path);
+cem_EXPORT CemJournal* cem_journal_open(CemModel* model, const char* path);
+cem_EXPORT int cem_journal_append(CemJournal* journal, CemModel* model);
+cem_EXPORT int cem_journal_close(CemJournal* journal);
+cem_EXPORT int cem_journal_num_records(const char* path);
+cem_EXPORT CemModel* cem_load_journal(Config config, const char* path, int record);
+
+/* Monte Carlo ensemble over stochastic wave angles, see ensemble.c */
+cem_EXPORT int cem_ensemble_num_saves(Config config);
+cem_EXPORT int cem_run_ensemble(Config config, const unsigned int* seeds, int numMembers, int numThreads,
+	const double* percentiles, int numPercentiles, double* shorelines, double* mean, double* percentileValues);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
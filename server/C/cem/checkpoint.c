@@ -0,0 +1,756 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cem.h"
+#include "CemModel.h"
+#include "consts.h"
+#include "BeachGrid.h"
+#include "BeachNode.h"
+#include "BeachProperties.h"
+#include "WaveClimate.h"
+#include "Shoreline.h"
+#include "Refraction.h"
+#include "TransportSegments.h"
+#include "ImplicitTransport.h"
+#include "utils.h"
+#include "config.h"
+
+/**
+ * Checkpoint file layout (native byte order):
+ *   header - magic, version, rows, cols, seed, then the time fields:
+ *            current_time_step, grid current_time, current_time,
+ *            cell_change_rate
+ *   raster - rows x cols frac_full values
+ *   shoreline - node count, index of the grid's shoreline head, then each
+ *            node of the next/prev chain from the start boundary to the
+ *            end boundary: row, col, is_boundary, frac_full, properties
+ *   transport cache - whether there is one; if so its step, wave angle,
+ *            height, period and timestep length, then the count and
+ *            (cell index, entry) pairs of the cells it saw at that step:
+ *            frac_full, transport_potential, prev, next, in_shadow,
+ *            transport_dir
+ *
+ * A journal is a journal header followed by a full checkpoint without the
+ * transport cache and one record per append: record mark, time fields,
+ * count of cells that may have changed, (cell index, frac_full) pairs,
+ * shoreline, end mark. A record cut short by a crash has no end mark and
+ * is ignored on replay.
+ */
+static const char CHECKPOINT_MAGIC[8] = { 'C', 'E', 'M', 'C', 'K', 'P', 'T', '\0' };
+static const char JOURNAL_MAGIC[8] = { 'C', 'E', 'M', 'J', 'R', 'N', 'L', '\0' };
+#define CHECKPOINT_VERSION (4)
+#define JOURNAL_VERSION (3)
+#define RECORD_MARK (0x52454344)
+#define RECORD_END (0x454e4452)
+
+/* bytes per shoreline node: row, col, is_boundary, frac_full, properties */
+#define NODE_BYTES (6 * sizeof(int32_t) + 6 * sizeof(double))
+
+struct CheckpointHeader {
+	int rows, cols, seed, current_time_step, grid_time;
+	double current_time, cell_change_rate;
+};
+
+struct CemJournal {
+	FILE* file;
+	int rows, cols;
+	int changes_stamp;            /* of the grid's change tracking, restarted at each record */
+};
+
+static int WriteHeader(FILE* file, const CemModel* model);
+static int WriteTime(FILE* file, const CemModel* model);
+static int WriteRaster(FILE* file, const struct BeachGrid* grid);
+static int WriteShoreline(FILE* file, const struct BeachGrid* grid);
+static int WriteChangedCells(FILE* file, const struct BeachGrid* grid, int is_tracked);
+static int WriteTransportCache(FILE* file, const struct BeachGrid* grid);
+static int ReadHeader(FILE* file, struct CheckpointHeader* header);
+static int ReadTime(FILE* file, struct CheckpointHeader* header);
+static int ReadShoreline(FILE* file, struct BeachGrid* grid);
+static int ReadTransportCache(FILE* file, struct BeachGrid* grid);
+static CemModel* RestoreModel(Config config, const struct CheckpointHeader* header, const double* raster, FILE* file);
+static int ReplayJournal(FILE* file, int max_records, struct CheckpointHeader* header, double** raster, long* shoreline_pos);
+static int WriteInt(FILE* file, int value);
+static int WriteDouble(FILE* file, double value);
+static int ReadInt(FILE* file, int* value);
+static int ReadDouble(FILE* file, double* value);
+static int WriteProperties(FILE* file, const struct BeachProperties* props);
+static int ReadProperties(FILE* file, struct BeachProperties* props);
+
+/**
+ * Write the full state of a model so a run can be resumed or branched
+ * PARAMETERS: path - checkpoint file, overwritten
+ * RETURN: 0 on success, -1 on failure
+ */
+int cem_save_checkpoint(const CemModel* model, const char* path)
+{
+	if (!model || !path)
+	{
+		return -1;
+	}
+	FILE* file = fopen(path, "wb");
+	if (!file)
+	{
+		return -1;
+	}
+
+	int ok = WriteHeader(file, model)
+		&& WriteRaster(file, &model->grid)
+		&& WriteShoreline(file, &model->grid)
+		&& WriteTransportCache(file, &model->grid);
+
+	if (fclose(file) != 0)
+	{
+		ok = FALSE;
+	}
+	return ok ? 0 : -1;
+}
+
+/**
+ * Create a model from a checkpoint. Wave inputs and sediment parameters are
+ * taken from config, so a spun-up coastline can be branched into scenarios;
+ * with the config of the saved run the model continues bit-identically.
+ * The incremental transport cache is restored with it when config has
+ * incremental on.
+ * RETURN: new model, NULL if the file is unreadable or does not match config
+ */
+CemModel* cem_load_checkpoint(Config config, const char* path)
+{
+	if (!path)
+	{
+		return NULL;
+	}
+	FILE* file = fopen(path, "rb");
+	if (!file)
+	{
+		return NULL;
+	}
+
+	struct CheckpointHeader header;
+	double* raster = NULL;
+	CemModel* model = NULL;
+	if (ReadHeader(file, &header) && header.rows == config.nRows && header.cols == config.nCols)
+	{
+		size_t num_cells = (size_t)header.rows * header.cols;
+		raster = malloc(num_cells * sizeof(double));
+		if (raster && fread(raster, sizeof(double), num_cells, file) == num_cells)
+		{
+			model = RestoreModel(config, &header, raster, file);
+		}
+	}
+	if (model && ReadTransportCache(file, &model->grid) != 0)
+	{
+		cem_destroy(model);
+		model = NULL;
+	}
+
+	free(raster);
+	fclose(file);
+	return model;
+}
+
+/**
+ * Start a journal with a full checkpoint of the model; later appends only
+ * store the cells the model's steps may have changed since the previous one
+ * PARAMETERS: path - journal file, overwritten
+ * RETURN: new journal, NULL on failure
+ */
+CemJournal* cem_journal_open(CemModel* model, const char* path)
+{
+	if (!model || !path)
+	{
+		return NULL;
+	}
+	CemJournal* journal = malloc(sizeof(CemJournal));
+	if (!journal)
+	{
+		return NULL;
+	}
+	journal->rows = model->grid.rows;
+	journal->cols = model->grid.cols;
+	journal->file = fopen(path, "wb");
+
+	int ok = journal->file
+		&& fwrite(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC), 1, journal->file) == 1
+		&& WriteInt(journal->file, JOURNAL_VERSION)
+		&& WriteHeader(journal->file, model)
+		&& WriteRaster(journal->file, &model->grid)
+		&& WriteShoreline(journal->file, &model->grid)
+		&& fflush(journal->file) == 0;
+	if (!ok)
+	{
+		cem_journal_close(journal);
+		return NULL;
+	}
+	journal->changes_stamp = model->grid.TrackChanges(&model->grid);
+	return journal;
+}
+
+/**
+ * Append the cells around every node the model had since the previous
+ * append (sediment only moves through those) and the current shoreline, so
+ * the cost scales with the shoreline rather than the grid. If another
+ * journal of the model restarted the change tracking since, the whole
+ * raster is written instead. Edits made through cem_get_raster are not
+ * seen. The record is flushed before returning.
+ * RETURN: 0 on success, -1 on failure
+ */
+int cem_journal_append(CemJournal* journal, CemModel* model)
+{
+	if (!journal || !model || model->grid.rows != journal->rows || model->grid.cols != journal->cols)
+	{
+		return -1;
+	}
+	FILE* file = journal->file;
+	struct BeachGrid* grid = &model->grid;
+	int is_tracked = grid->changes.is_tracking && grid->changes.stamp == journal->changes_stamp;
+
+	int ok = WriteInt(file, RECORD_MARK)
+		&& WriteTime(file, model)
+		&& WriteChangedCells(file, grid, is_tracked)
+		&& WriteShoreline(file, grid)
+		&& WriteInt(file, RECORD_END)
+		&& fflush(file) == 0;
+	journal->changes_stamp = grid->TrackChanges(grid);
+	return ok ? 0 : -1;
+}
+
+int cem_journal_close(CemJournal* journal)
+{
+	if (!journal)
+	{
+		return -1;
+	}
+	int status = 0;
+	if (journal->file && fclose(journal->file) != 0)
+	{
+		status = -1;
+	}
+	free(journal);
+	return status;
+}
+
+/**
+ * Number of complete records in a journal, not counting its base checkpoint
+ * RETURN: record count, -1 if the file is not a readable journal
+ */
+int cem_journal_num_records(const char* path)
+{
+	FILE* file = path ? fopen(path, "rb") : NULL;
+	if (!file)
+	{
+		return -1;
+	}
+	struct CheckpointHeader header;
+	double* raster = NULL;
+	long shoreline_pos;
+	int num_records = ReplayJournal(file, -1, &header, &raster, &shoreline_pos);
+	free(raster);
+	fclose(file);
+	return num_records;
+}
+
+/**
+ * Create a model from the state a journal recorded, for resuming a run or
+ * scrubbing through its history (cem_update(model, 0) returns the grid).
+ * Journals do not keep the incremental transport cache, so with a nonzero
+ * incrementalTolerance a loaded model may drift from the journaled run.
+ * PARAMETERS: record - 0 for the base checkpoint, n for the state after the
+ *   nth append, < 0 for the latest complete record
+ * RETURN: new model, NULL if the journal is unreadable, does not match
+ *   config or has fewer records
+ */
+CemModel* cem_load_journal(Config config, const char* path, int record)
+{
+	FILE* file = path ? fopen(path, "rb") : NULL;
+	if (!file)
+	{
+		return NULL;
+	}
+	struct CheckpointHeader header;
+	double* raster = NULL;
+	long shoreline_pos;
+	CemModel* model = NULL;
+	int num_records = ReplayJournal(file, record, &header, &raster, &shoreline_pos);
+	if (num_records >= 0 && (record < 0 || num_records == record)
+		&& header.rows == config.nRows && header.cols == config.nCols
+		&& fseek(file, shoreline_pos, SEEK_SET) == 0)
+	{
+		model = RestoreModel(config, &header, raster, file);
+	}
+
+	free(raster);
+	fclose(file);
+	return model;
+}
+
+/**
+ * Read a journal's base checkpoint and apply up to max_records records
+ * (all if < 0) to its raster and time fields
+ * OUTPUT: header, raster (caller frees), shoreline_pos - file offset of the
+ *   shoreline of the last applied record
+ * RETURN: number of records applied, -1 if the base is unreadable
+ */
+static int ReplayJournal(FILE* file, int max_records, struct CheckpointHeader* header, double** raster, long* shoreline_pos)
+{
+	char magic[sizeof(JOURNAL_MAGIC)];
+	int version;
+	*raster = NULL;
+	if (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) != 0
+		|| !ReadInt(file, &version) || version != JOURNAL_VERSION
+		|| !ReadHeader(file, header))
+	{
+		return -1;
+	}
+
+	int num_cells = header->rows * header->cols;
+	*raster = malloc(num_cells * sizeof(double));
+	int* changed_index = malloc(num_cells * sizeof(int));
+	double* changed_frac = malloc(num_cells * sizeof(double));
+	int num_nodes, head_index;
+	if (!*raster || !changed_index || !changed_frac
+		|| fread(*raster, sizeof(double), num_cells, file) != (size_t)num_cells
+		|| (*shoreline_pos = ftell(file)) < 0
+		|| !ReadInt(file, &num_nodes) || !ReadInt(file, &head_index) || num_nodes < 0
+		|| fseek(file, (long)(num_nodes * NODE_BYTES), SEEK_CUR) != 0)
+	{
+		free(changed_index);
+		free(changed_frac);
+		return -1;
+	}
+
+	int num_records = 0;
+	while (max_records < 0 || num_records < max_records)
+	{
+		// read the whole record before applying it, a truncated one is dropped
+		struct CheckpointHeader time = *header;
+		int mark, num_changed, end, i;
+		long pos = 0;
+		int ok = ReadInt(file, &mark) && mark == RECORD_MARK
+			&& ReadTime(file, &time)
+			&& ReadInt(file, &num_changed) && num_changed >= 0 && num_changed <= num_cells;
+		for (i = 0; ok && i < num_changed; i++)
+		{
+			ok = ReadInt(file, &changed_index[i]) && changed_index[i] >= 0 && changed_index[i] < num_cells
+				&& ReadDouble(file, &changed_frac[i]);
+		}
+		ok = ok && (pos = ftell(file)) >= 0
+			&& ReadInt(file, &num_nodes) && ReadInt(file, &head_index) && num_nodes >= 0
+			&& fseek(file, (long)(num_nodes * NODE_BYTES), SEEK_CUR) == 0
+			&& ReadInt(file, &end) && end == RECORD_END;
+		if (!ok)
+		{
+			break;
+		}
+
+		for (i = 0; i < num_changed; i++)
+		{
+			(*raster)[changed_index[i]] = changed_frac[i];
+		}
+		*header = time;
+		*shoreline_pos = pos;
+		num_records++;
+	}
+
+	free(changed_index);
+	free(changed_frac);
+	return num_records;
+}
+
+/**
+ * Build a model from a raster and the shoreline stored at the current
+ * position of file
+ * RETURN: new model, NULL on failure
+ */
+static CemModel* RestoreModel(Config config, const struct CheckpointHeader* header, const double* raster, FILE* file)
+{
+	CemModel* model = malloc(sizeof(CemModel));
+	if (!model)
+	{
+		return NULL;
+	}
+	model->config = config;
+	model->current_time_step = header->current_time_step;
+	model->current_time = header->current_time;
+	model->cell_change_rate = header->cell_change_rate;
+	model->shoreline = Shoreline.new();
+	model->refraction = Refraction.new(config.refraction, config.breakingTolerance);
+	model->closure_depth = ClosureDepth.new(config);
+	model->segments = TransportSegments.new(config.engine == ENGINE_ARRAYS ? config.transportThreads : 0);
+	model->implicit = ImplicitTransport.new();
+	model->wave_climate = WaveClimate.new(config.wavePeriods, config.waveAngles, config.waveHeights,
+		config.asymmetry, config.stability, config.numTimesteps, config.numWaveInputs, (unsigned int)header->seed);
+	model->grid = BeachGrid.new(header->rows, header->cols, config.cellWidth, config.cellLength);
+	model->grid.current_time = header->grid_time;
+	model->grid.transport_cache.is_active = config.incremental;
+	model->grid.transport_cache.tolerance = config.incrementalTolerance;
+	model->output_grid = malloc(header->rows * header->cols * sizeof(double));
+
+	int r;
+	for (r = 0; r < header->rows; r++)
+	{
+		memcpy(model->grid.frac_full[r], raster + (size_t)r * header->cols, header->cols * sizeof(double));
+	}
+
+	if (!model->output_grid
+		|| WaveClimate.condense(&model->wave_climate, config.waveAngleBins, config.waveHeightBins, config.morphologicalFactor) != 0
+		|| ReadShoreline(file, &model->grid) != 0)
+	{
+		cem_destroy(model);
+		return NULL;
+	}
+	return model;
+}
+
+static int WriteHeader(FILE* file, const CemModel* model)
+{
+	return fwrite(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC), 1, file) == 1
+		&& WriteInt(file, CHECKPOINT_VERSION)
+		&& WriteInt(file, model->grid.rows)
+		&& WriteInt(file, model->grid.cols)
+		&& WriteInt(file, (int)model->wave_climate.seed)
+		&& WriteTime(file, model);
+}
+
+static int WriteTime(FILE* file, const CemModel* model)
+{
+	return WriteInt(file, model->current_time_step)
+		&& WriteInt(file, model->grid.current_time)
+		&& WriteDouble(file, model->current_time)
+		&& WriteDouble(file, model->cell_change_rate);
+}
+
+static int ReadHeader(FILE* file, struct CheckpointHeader* header)
+{
+	char magic[sizeof(CHECKPOINT_MAGIC)];
+	int version;
+	return fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) == 0
+		&& ReadInt(file, &version) && version == CHECKPOINT_VERSION
+		&& ReadInt(file, &header->rows) && header->rows > 0
+		&& ReadInt(file, &header->cols) && header->cols > 0
+		&& ReadInt(file, &header->seed)
+		&& ReadTime(file, header);
+}
+
+static int ReadTime(FILE* file, struct CheckpointHeader* header)
+{
+	return ReadInt(file, &header->current_time_step)
+		&& ReadInt(file, &header->grid_time)
+		&& ReadDouble(file, &header->current_time)
+		&& ReadDouble(file, &header->cell_change_rate);
+}
+
+static int WriteRaster(FILE* file, const struct BeachGrid* grid)
+{
+	int r, c;
+	for (r = 0; r < grid->rows; r++)
+	{
+		for (c = 0; c < grid->cols; c++)
+		{
+			if (!WriteDouble(file, grid->frac_full[r][c]))
+			{
+				return FALSE;
+			}
+		}
+	}
+	return TRUE;
+}
+
+// rows of column c the grid's change tracking covers, clipped to the grid
+static void GetChangedRows(const struct BeachGrid* grid, int c, int* top, int* bottom)
+{
+	*top = grid->changes.top[c] > 0 ? grid->changes.top[c] : 0;
+	*bottom = grid->changes.bottom[c] < grid->rows - 1 ? grid->changes.bottom[c] : grid->rows - 1;
+}
+
+// count and (cell index, frac_full) pairs of the tracked cells, or of every cell
+static int WriteChangedCells(FILE* file, const struct BeachGrid* grid, int is_tracked)
+{
+	int r, c, top, bottom;
+	if (!is_tracked)
+	{
+		int ok = WriteInt(file, grid->rows * grid->cols);
+		for (r = 0; ok && r < grid->rows; r++)
+		{
+			for (c = 0; ok && c < grid->cols; c++)
+			{
+				ok = WriteInt(file, r * grid->cols + c) && WriteDouble(file, grid->frac_full[r][c]);
+			}
+		}
+		return ok;
+	}
+
+	int num_changed = 0;
+	for (c = 0; c < grid->cols; c++)
+	{
+		GetChangedRows(grid, c, &top, &bottom);
+		num_changed += bottom >= top ? bottom - top + 1 : 0;
+	}
+	int ok = WriteInt(file, num_changed);
+	for (c = 0; ok && c < grid->cols; c++)
+	{
+		GetChangedRows(grid, c, &top, &bottom);
+		for (r = top; ok && r <= bottom; r++)
+		{
+			ok = WriteInt(file, r * grid->cols + c) && WriteDouble(file, grid->frac_full[r][c]);
+		}
+	}
+	return ok;
+}
+
+static int WriteShoreline(FILE* file, const struct BeachGrid* grid)
+{
+	// locate the start of the chain and the position of the head within it
+	struct BeachNode* start = grid->shoreline;
+	int head_index = 0;
+	while (start && start->prev)
+	{
+		start = start->prev;
+		head_index++;
+	}
+	int num_nodes = 0;
+	struct BeachNode* curr;
+	for (curr = start; curr; curr = curr->next)
+	{
+		num_nodes++;
+	}
+
+	int ok = WriteInt(file, num_nodes) && WriteInt(file, head_index);
+	for (curr = start; ok && curr; curr = curr->next)
+	{
+		ok = WriteInt(file, curr->row)
+			&& WriteInt(file, curr->col)
+			&& WriteInt(file, curr->is_boundary)
+			&& WriteDouble(file, *curr->frac_full)
+			&& WriteProperties(file, curr->properties);
+	}
+	return ok;
+}
+
+// the transport cache entries of the cells on the shoreline at its last step, the rest count as moved
+static int WriteTransportCache(FILE* file, const struct BeachGrid* grid)
+{
+	const struct TransportCache* cache = &grid->transport_cache;
+	if (!cache->is_active || !cache->entries)
+	{
+		return WriteInt(file, FALSE);
+	}
+
+	int num_cells = grid->rows * grid->cols;
+	int num_seen = 0;
+	int i;
+	for (i = 0; i < num_cells; i++)
+	{
+		num_seen += cache->entries[i].visited == cache->step;
+	}
+	int ok = WriteInt(file, TRUE)
+		&& WriteInt(file, cache->step)
+		&& WriteDouble(file, cache->wave_angle)
+		&& WriteDouble(file, cache->wave_height)
+		&& WriteDouble(file, cache->wave_period)
+		&& WriteDouble(file, cache->timestep_length)
+		&& WriteInt(file, num_seen);
+	for (i = 0; ok && i < num_cells; i++)
+	{
+		const struct TransportEntry* entry = &cache->entries[i];
+		if (entry->visited == cache->step)
+		{
+			ok = WriteInt(file, i)
+				&& WriteDouble(file, entry->frac_full)
+				&& WriteDouble(file, entry->transport_potential)
+				&& WriteInt(file, entry->prev)
+				&& WriteInt(file, entry->next)
+				&& WriteInt(file, entry->in_shadow)
+				&& WriteInt(file, (int)entry->transport_dir);
+		}
+	}
+	return ok;
+}
+
+/**
+ * Restore the transport cache into a grid whose cache is active, left cold
+ * if the checkpoint has none
+ * RETURN: 0 on success, -1 on failure
+ */
+static int ReadTransportCache(FILE* file, struct BeachGrid* grid)
+{
+	struct TransportCache* cache = &grid->transport_cache;
+	int has_cache;
+	if (!ReadInt(file, &has_cache))
+	{
+		return -1;
+	}
+	if (!has_cache || !cache->is_active)
+	{
+		return 0;
+	}
+
+	int num_cells = grid->rows * grid->cols;
+	int num_seen;
+	cache->entries = calloc((size_t)num_cells, sizeof(struct TransportEntry));
+	int ok = cache->entries
+		&& ReadInt(file, &cache->step)
+		&& ReadDouble(file, &cache->wave_angle)
+		&& ReadDouble(file, &cache->wave_height)
+		&& ReadDouble(file, &cache->wave_period)
+		&& ReadDouble(file, &cache->timestep_length)
+		&& ReadInt(file, &num_seen) && num_seen >= 0 && num_seen <= num_cells;
+	int i;
+	for (i = 0; ok && i < num_seen; i++)
+	{
+		int index, transport_dir;
+		struct TransportEntry entry;
+		ok = ReadInt(file, &index) && index >= 0 && index < num_cells
+			&& ReadDouble(file, &entry.frac_full)
+			&& ReadDouble(file, &entry.transport_potential)
+			&& ReadInt(file, &entry.prev)
+			&& ReadInt(file, &entry.next)
+			&& ReadInt(file, &entry.in_shadow)
+			&& ReadInt(file, &transport_dir);
+		entry.transport_dir = (FLOW_DIR)transport_dir;
+		entry.visited = cache->step;
+		if (ok)
+		{
+			cache->entries[index] = entry;
+		}
+	}
+	return ok ? 0 : -1;
+}
+
+/**
+ * Rebuild the next/prev chain: cell nodes are added to the grid's node
+ * table, boundary nodes are allocated, and the chain is numbered for
+ * RepairShoreline. On failure the partial chain is released.
+ * RETURN: 0 on success, -1 on failure
+ */
+static int ReadShoreline(FILE* file, struct BeachGrid* grid)
+{
+	int num_nodes, head_index;
+	if (!ReadInt(file, &num_nodes) || !ReadInt(file, &head_index)
+		|| num_nodes < 2 || head_index < 0 || head_index >= num_nodes)
+	{
+		return -1;
+	}
+
+	struct BeachNode** chain = calloc(num_nodes, sizeof(struct BeachNode*));
+	int ok = chain != NULL;
+	int i;
+	for (i = 0; ok && i < num_nodes; i++)
+	{
+		int row, col, is_boundary;
+		double frac_full;
+		struct BeachProperties props;
+		ok = ReadInt(file, &row) && ReadInt(file, &col) && ReadInt(file, &is_boundary)
+			&& ReadDouble(file, &frac_full) && ReadProperties(file, &props);
+		if (!ok)
+		{
+			break;
+		}
+
+		struct BeachNode* node;
+		if (is_boundary)
+		{
+			node = BeachNode.boundary(&grid->node_pool, row, col);
+			*node->frac_full = frac_full;
+		}
+		else
+		{
+			node = grid->TryGetNode(grid, row, col) ? NULL : grid->AddNode(grid, row, col);
+			if (!node)
+			{
+				ok = FALSE;
+				break;
+			}
+		}
+		*node->properties = props;
+		chain[i] = node;
+
+		if (i > 0)
+		{
+			chain[i - 1]->next = node;
+			node->prev = chain[i - 1];
+		}
+	}
+
+	if (ok)
+	{
+		grid->SetShoreline(grid, chain[head_index]);
+		grid->OrderShoreline(grid);
+		free(chain);
+		return 0;
+	}
+
+	for (i = 0; chain && i < num_nodes && chain[i]; i++)
+	{
+		if (chain[i]->is_boundary)
+		{
+			BeachNode.free(&grid->node_pool, chain[i]);
+		}
+		else
+		{
+			grid->RemoveNode(grid, chain[i]);
+		}
+	}
+	free(chain);
+	return -1;
+}
+
+static int WriteProperties(FILE* file, const struct BeachProperties* props)
+{
+	struct BeachProperties empty = BeachProperties.new();
+	if (!props)
+	{
+		props = &empty;
+	}
+	return WriteDouble(file, props->transport_potential)
+		&& WriteDouble(file, props->net_volume_change)
+		&& WriteDouble(file, props->prev_angle)
+		&& WriteDouble(file, props->next_angle)
+		&& WriteDouble(file, props->surrounding_angle)
+		&& WriteInt(file, props->in_shadow)
+		&& WriteInt(file, props->shadow_timestamp)
+		&& WriteInt(file, (int)props->transport_dir);
+}
+
+static int ReadProperties(FILE* file, struct BeachProperties* props)
+{
+	int transport_dir;
+	int ok = ReadDouble(file, &props->transport_potential)
+		&& ReadDouble(file, &props->net_volume_change)
+		&& ReadDouble(file, &props->prev_angle)
+		&& ReadDouble(file, &props->next_angle)
+		&& ReadDouble(file, &props->surrounding_angle)
+		&& ReadInt(file, &props->in_shadow)
+		&& ReadInt(file, &props->shadow_timestamp)
+		&& ReadInt(file, &transport_dir);
+	props->transport_dir = (FLOW_DIR)transport_dir;
+	return ok;
+}
+
+static int WriteInt(FILE* file, int value)
+{
+	int32_t v = (int32_t)value;
+	return fwrite(&v, sizeof(v), 1, file) == 1;
+}
+
+static int WriteDouble(FILE* file, double value)
+{
+	return fwrite(&value, sizeof(value), 1, file) == 1;
+}
+
+static int ReadInt(FILE* file, int* value)
+{
+	int32_t v;
+	if (fread(&v, sizeof(v), 1, file) != 1)
+	{
+		return FALSE;
+	}
+	*value = (int)v;
+	return TRUE;
+}
+
+static int ReadDouble(FILE* file, double* value)
+{
+	return fread(value, sizeof(*value), 1, file) == 1;
+}
@@ -5,6 +5,31 @@
 extern "C" {
 #endif
 
+	/* Shoreline representation used by the sediment transport phases */
+	typedef enum {
+		ENGINE_LINKED_LIST = 0,
+		ENGINE_ARRAYS = 1
+	} ENGINE;
+
+	/* How breaking waves are refracted: the exact depth march, a table over the deep water angle,
+	   a root solve for the breaking depth to within breakingTolerance (meters, <= 0 for the default),
+	   or the march run on SIMD batches of nodes */
+	typedef enum {
+		REFRACTION_MARCH = 0,
+		REFRACTION_TABLE = 1,
+		REFRACTION_SOLVE = 2,
+		REFRACTION_VECTOR = 3
+	} REFRACTION;
+
+	/* How the depth of closure of a node is found when depthOfClosure is 0: from the equations, or from
+	   a table of closureDepthBins (<= 0 for the default) shore angle bins per row, at the nearest bin or
+	   interpolated */
+	typedef enum {
+		CLOSURE_DEPTH_EXACT = 0,
+		CLOSURE_DEPTH_TABLE = 1,
+		CLOSURE_DEPTH_INTERPOLATED = 2
+	} CLOSURE_DEPTH;
+
 	typedef struct _Config {
 		double** grid;
 		double* waveHeights;
@@ -27,6 +52,32 @@ extern "C" {
 		double lengthTimestep;
 		int numTimesteps;
 		int saveInterval;
+		int engine;
+		int refraction;
+		double breakingTolerance;
+		/* Linked list engine: reuse the transport potential of nodes whose wave, shadows and surrounding
+		   frac_full (to within incrementalTolerance) held since it was computed, 0 tolerance stays exact */
+		int incremental;
+		double incrementalTolerance;
+		int closureDepth;
+		int closureDepthBins;
+		/* Arrays engine: threads running the transport phases over contiguous shoreline segments, 0 or 1
+		   for the calling thread alone and < 0 for one per core. Results do not depend on it */
+		int transportThreads;
+		/* Size transport steps so no cell's frac_full changes by more than maxCellChange (<= 0 for the
+		   default): timesteps with the same wave merge up to the end of a cem_step call, stormy ones split */
+		int adaptiveTimestep;
+		double maxCellChange;
+		/* Morphological acceleration: condense the wave series into representative conditions of waveAngleBins
+		   angle bins per half plane by waveHeightBins height classes (<= 0 for the defaults), weighted by how
+		   often they occur, and take one transport step per morphologicalFactor timesteps (<= 1 runs the full
+		   series). adaptiveTimestep then only splits steps, never merges them */
+		int morphologicalFactor;
+		int waveAngleBins;
+		int waveHeightBins;
+		/* Arrays engine: solve the sediment budget of steps whose waves reach the whole shoreline at low
+		   angles implicitly, stable on smooth coasts for much longer lengthTimestep; others stay explicit */
+		int implicitTransport;
 	} Config;
 
 #if defined(__cplusplus)
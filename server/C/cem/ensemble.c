@@ -0,0 +1,232 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cem.h"
+#include "CemModel.h"
+#include "consts.h"
+#include "ThreadPool.h"
+#include "WaveClimate.h"
+#include "config.h"
+
+struct EnsembleRun {
+	Config config;
+	const struct WaveClimate* waves;
+	const unsigned int* seeds;
+	int num_members, num_saves;
+	const double* percentiles;
+	int num_percentiles;
+	double* shorelines;
+	double* mean;
+	double* percentile_values;
+	int* status;
+	double* values;               /* scratch of ComputeStatistics, num_members per save */
+};
+
+static void GetShorelinePositions(CemRaster grid, double* positions);
+static void RunMember(void* args, int member);
+static void ComputeStatistics(void* args, int save);
+static int CompareDoubles(const void* a, const void* b);
+
+int cem_ensemble_num_saves(Config config)
+{
+	if (config.saveInterval <= 0)
+	{
+		return 0;
+	}
+	return (config.numTimesteps + config.saveInterval - 1) / config.saveInterval;
+}
+
+/**
+ * Run one model per seed on a thread pool, sharing the read-only wave inputs
+ * PARAMETERS:
+ *   seeds - numMembers random seeds, one stochastic wave sequence per member
+ *   numThreads - pool size, <= 0 for one thread per core
+ *   percentiles - numPercentiles values in [0, 100]
+ * OUTPUT (caller allocated, numSaves = cem_ensemble_num_saves(config)):
+ *   shorelines - numMembers x numSaves x nCols cross-shore shoreline positions
+ *   mean - numSaves x nCols ensemble mean
+ *   percentileValues - numPercentiles x numSaves x nCols
+ * Columns without shoreline are EMPTY_double and ignored by the statistics.
+ * RETURN: 0 on success, -1 if any member failed to run
+ */
+int cem_run_ensemble(Config config, const unsigned int* seeds, int numMembers, int numThreads,
+	const double* percentiles, int numPercentiles, double* shorelines, double* mean, double* percentileValues)
+{
+	int num_saves = cem_ensemble_num_saves(config);
+	if (numMembers <= 0 || num_saves <= 0)
+	{
+		return -1;
+	}
+
+	struct WaveClimate waves = WaveClimate.new(config.wavePeriods, config.waveAngles, config.waveHeights,
+		config.asymmetry, config.stability, config.numTimesteps, config.numWaveInputs, 0);
+	struct ThreadPool* pool = ThreadPool.new(numThreads);
+	int* status = malloc(numMembers * sizeof(int));
+	double* values = malloc((size_t)num_saves * numMembers * sizeof(double));
+	if (!pool || !status || !values)
+	{
+		free(status);
+		free(values);
+		ThreadPool.free(pool);
+		WaveClimate.free(&waves);
+		return -1;
+	}
+
+	struct EnsembleRun run = {
+		.config = config,
+		.waves = &waves,
+		.seeds = seeds,
+		.num_members = numMembers,
+		.num_saves = num_saves,
+		.percentiles = percentiles,
+		.num_percentiles = numPercentiles,
+		.shorelines = shorelines,
+		.mean = mean,
+		.percentile_values = percentileValues,
+		.status = status,
+		.values = values
+	};
+
+	pool->Run(pool, &RunMember, &run, numMembers);
+	pool->Run(pool, &ComputeStatistics, &run, num_saves);
+
+	int result = 0;
+	int i;
+	for (i = 0; i < numMembers; i++)
+	{
+		if (status[i] != 0)
+		{
+			result = -1;
+		}
+	}
+
+	free(status);
+	free(values);
+	ThreadPool.free(pool);
+	WaveClimate.free(&waves);
+	return result;
+}
+
+static void RunMember(void* args, int member)
+{
+	struct EnsembleRun* run = args;
+	int n_cols = run->config.nCols;
+	size_t member_size = (size_t)run->num_saves * n_cols;
+	double* member_shorelines = run->shorelines + member * member_size;
+
+	// members already keep the pool busy, so each runs its transport serially
+	Config config = run->config;
+	config.transportThreads = 0;
+	CemModel* model = CreateModel(config, run->waves, run->seeds[member]);
+	if (!model)
+	{
+		size_t i;
+		for (i = 0; i < member_size; i++)
+		{
+			member_shorelines[i] = EMPTY_double;
+		}
+		run->status[member] = -1;
+		return;
+	}
+
+	int step = 0;
+	int save;
+	for (save = 0; save < run->num_saves; save++)
+	{
+		int steps = (step + run->config.saveInterval) < run->config.numTimesteps ? run->config.saveInterval : (run->config.numTimesteps - step);
+		if (cem_step(model, steps) != 0)
+		{
+			// the member lost its shoreline, it has no positions from here on
+			size_t i;
+			for (i = (size_t)save * n_cols; i < member_size; i++)
+			{
+				member_shorelines[i] = EMPTY_double;
+			}
+			cem_destroy(model);
+			run->status[member] = -1;
+			return;
+		}
+		GetShorelinePositions(cem_get_raster(model), member_shorelines + save * n_cols);
+		step += steps;
+	}
+
+	cem_destroy(model);
+	run->status[member] = 0;
+}
+
+static void ComputeStatistics(void* args, int save)
+{
+	struct EnsembleRun* run = args;
+	int n_cols = run->config.nCols;
+	size_t member_size = (size_t)run->num_saves * n_cols;
+	double* values = run->values + (size_t)save * run->num_members;
+
+	int c, m, p;
+	for (c = 0; c < n_cols; c++)
+	{
+		int n = 0;
+		double sum = 0.0;
+		for (m = 0; m < run->num_members; m++)
+		{
+			double position = run->shorelines[m * member_size + save * n_cols + c];
+			if (position != EMPTY_double)
+			{
+				values[n++] = position;
+				sum += position;
+			}
+		}
+
+		int i = save * n_cols + c;
+		if (n == 0)
+		{
+			run->mean[i] = EMPTY_double;
+			for (p = 0; p < run->num_percentiles; p++)
+			{
+				run->percentile_values[p * member_size + i] = EMPTY_double;
+			}
+			continue;
+		}
+		run->mean[i] = sum / n;
+
+		// percentiles by linear interpolation between closest ranks
+		qsort(values, n, sizeof(double), &CompareDoubles);
+		for (p = 0; p < run->num_percentiles; p++)
+		{
+			double rank = (run->percentiles[p] / 100.0) * (n - 1);
+			rank = rank < 0 ? 0 : (rank > n - 1 ? n - 1 : rank);
+			int lo = (int)floor(rank);
+			int hi = lo + 1 < n ? lo + 1 : lo;
+			run->percentile_values[p * member_size + i] = values[lo] + (rank - lo) * (values[hi] - values[lo]);
+		}
+	}
+}
+
+/**
+ * Cross-shore shoreline position per column: first partially full cell
+ * from the top, offset by its empty fraction (matches analyses.getShoreline)
+ */
+static void GetShorelinePositions(CemRaster grid, double* positions)
+{
+	int r, c;
+	for (c = 0; c < grid.nCols; c++)
+	{
+		positions[c] = EMPTY_double;
+		for (r = 0; r < grid.nRows; r++)
+		{
+			double frac_full = grid.data[r * grid.rowStride + c];
+			if (frac_full > 0)
+			{
+				positions[c] = r + (1 - frac_full);
+				break;
+			}
+		}
+	}
+}
+
+static int CompareDoubles(const void* a, const void* b)
+{
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
@@ -1,215 +1,851 @@
 #include "sedtrans.h"
 #include "consts.h"
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "BeachNode.h"
 #include "BeachGrid.h"
 
 
-double GetTransportVolumePotential(double alpha, double wave_height, double timestep_length, double k);
 void OopsImEmpty(struct BeachGrid* grid, struct BeachNode* node);
 void OopsImFull(struct BeachGrid* grid, struct BeachNode* node);
-double GetDepthOfClosure(struct BeachNode* node, int ref_pos, double shelf_depth_at_ref_pos, double shelf_slope, double shoreface_slope, double shore_angle, double min_shelf_depth_at_closure, int cell_size);
 double ModTowardZero(double a, double m);
 double RoundRadians(double angle, double round_to, double bias);
 double GetDir(double shore_angle);
-struct BeachNode* GetNodeInDir(struct BeachGrid* grid, struct BeachNode* node, double dir);
+double* GetCellInDir(struct BeachGrid* grid, int r, int c, double dir);
+static void WaveTransformationIncremental(struct BeachGrid* grid, struct Refraction* refraction, double wave_angle, double wave_period, double wave_height, double timestep_length, double k);
+static int ReserveTransportCache(struct BeachGrid* grid);
+static int GetTransportCacheKey(struct BeachGrid* grid, struct BeachNode* node);
+static double GetNodeTransportPotential(struct BeachGrid* grid, struct Refraction* refraction, struct BeachNode* node, double wave_angle, double timestep_length, double k);
+static void LimitToSupply(FLOW_DIR dir, double volume_available, double prev_potential, double potential, double* prev_limited, double* limited);
+static double GetNetVolumeChange(FLOW_DIR dir, double prev_potential, double potential);
 
 
-void WaveTransformation(struct BeachGrid* grid, double wave_angle, double wave_period, double wave_height, double timestep_length, double k)
+void WaveTransformation(struct BeachGrid* grid, struct Refraction* refraction, double wave_angle, double wave_period, double wave_height, double timestep_length, double k)
 {
-	double start_depth = 3 * wave_height;       // (meters) depth to begin refraction calculations
-	double refract_step = 0.2;                  // (meters) step size to iterate through depth
-	double k_break = 0.5;                       // coefficient such that waves break at Hs > k_break*depth
+	if (grid->transport_cache.is_active)
+	{
+		WaveTransformationIncremental(grid, refraction, wave_angle, wave_period, wave_height, timestep_length, k);
+		return;
+	}
 
 	struct BeachNode* curr = grid->shoreline;
+	(*grid).SetShadowHorizon(grid, wave_angle);
+	refraction->SetWave(refraction, wave_height, wave_period);
 
 	while (!curr->is_boundary)
 	{
-		curr->properties->transport_potential = 0;
+		curr->properties->transport_potential = GetNodeTransportPotential(grid, refraction, curr, wave_angle, timestep_length, k);
+		curr = curr->next;
+	}
+	(*grid).ClearShadowHorizon(grid);
+}
 
-		double alpha_deep;
-		double shore_angle = (*grid).GetAngleByDifferencingScheme(grid, curr, wave_angle);
-		alpha_deep = fabs(shore_angle - EMPTY_double) < 1 ? PI / 4 : wave_angle - shore_angle;
+/**
+ * WaveTransformation recomputing only the nodes near a moved cell. A node's
+ * potential depends on the wave, the shadows of the node before to two after
+ * it and, through the angles of the differencing scheme, the cells two before
+ * to three after it. A cell moves when it joins the shoreline, its chain
+ * neighbors or shadow change, or its frac_full drifts by more than the
+ * tolerance from the value it was last seen moving at; a new wave moves
+ * every cell. Reused potentials are then off by at most the effect of twice
+ * the tolerance in each cell around them, and exact with a tolerance of 0.
+ */
+static void WaveTransformationIncremental(struct BeachGrid* grid, struct Refraction* refraction, double wave_angle, double wave_period, double wave_height, double timestep_length, double k)
+{
+	struct TransportCache* cache = &grid->transport_cache;
+	int n = ReserveTransportCache(grid);
+	if (n < 0)
+	{
+		cache->is_active = FALSE;
+		WaveTransformation(grid, refraction, wave_angle, wave_period, wave_height, timestep_length, k);
+		return;
+	}
 
-		if (fabs(alpha_deep) > (0.995 * PI / 2) || (fabs(shore_angle - EMPTY_double) > 1 && fabs(shore_angle) > (PI / 2)))
+	(*grid).SetShadowHorizon(grid, wave_angle);
+	refraction->SetWave(refraction, wave_height, wave_period);
+
+	int new_wave = wave_angle != cache->wave_angle || wave_height != cache->wave_height || wave_period != cache->wave_period
+		|| timestep_length != cache->timestep_length;
+	cache->wave_angle = wave_angle;
+	cache->wave_height = wave_height;
+	cache->wave_period = wave_period;
+	cache->timestep_length = timestep_length;
+	cache->step++;
+
+	int i, j;
+	for (i = 0; i < n; i++)
+	{
+		struct BeachNode* node = cache->chain[i];
+		struct TransportEntry* entry = &cache->entries[node->row * grid->cols + node->col];
+		int prev = GetTransportCacheKey(grid, node->prev);
+		int next = GetTransportCacheKey(grid, node->next);
+		int in_shadow = (*grid).CheckIfInShadow(grid, node, wave_angle);
+
+		cache->moved[i] = new_wave || entry->visited != cache->step - 1
+			|| fabs(*node->frac_full - entry->frac_full) > cache->tolerance
+			|| entry->prev != prev || entry->next != next || entry->in_shadow != in_shadow;
+		if (cache->moved[i])
 		{
-			curr->properties->transport_potential = 0.0;
-			curr = curr->next;
-			continue;
+			entry->frac_full = *node->frac_full;
+			entry->prev = prev;
+			entry->next = next;
+			entry->in_shadow = in_shadow;
 		}
+		entry->visited = cache->step;
+	}
 
-		double local_wave_height = wave_height;
+	for (i = 0; i < n; i++)
+	{
+		struct BeachNode* node = cache->chain[i];
+		struct TransportEntry* entry = &cache->entries[node->row * grid->cols + node->col];
 
-		double c_deep = (GRAVITY * wave_period) / (2 * PI);
-		double l_deep = c_deep * wave_period;
-		double local_depth = start_depth;
-		double local_alpha;
+		int is_dirty = FALSE;
+		for (j = i - 2; j <= i + 3 && !is_dirty; j++)
+		{
+			is_dirty = j >= 0 && j < n && cache->moved[j];
+		}
 
-		while (TRUE) {
-			// non-iterative eqn or L, from Fenton & McKee
-			double wave_length = l_deep * pow(tanh(pow(pow(2.0 * PI / wave_period, 2.0) * local_depth / GRAVITY, .75)), 2.0 / 3.0);
-			double local_c = wave_length / wave_period;
+		if (is_dirty)
+		{
+			entry->transport_potential = GetNodeTransportPotential(grid, refraction, node, wave_angle, timestep_length, k);
+			entry->transport_dir = node->properties->transport_dir;
+		}
+		node->properties->transport_potential = entry->transport_potential;
+		node->properties->transport_dir = entry->transport_dir;
+	}
+	(*grid).ClearShadowHorizon(grid);
+}
 
-			// n = 1/2(1+2kh/sinh(kh)) Komar 5.21
-			// kh = 2 pi depth/L  from k = 2 pi/L
-			double kh = 2 * PI * local_depth / wave_length;
-			double n = 0.5 * (1 + 2.0 * kh / sinh(2.0 * kh));
+/**
+ * Size the transport cache for the current shoreline and list its nodes in
+ * chain order
+ * RETURN: number of nodes, -1 if the cache could not be allocated
+ */
+static int ReserveTransportCache(struct BeachGrid* grid)
+{
+	struct TransportCache* cache = &grid->transport_cache;
+	if (!cache->entries)
+	{
+		cache->entries = calloc((size_t)grid->rows * grid->cols, sizeof(struct TransportEntry));
+		if (!cache->entries)
+		{
+			return -1;
+		}
+	}
 
-			// Calculate angle, assuming shore parallel contours and no conv/div of rays from Komar 5.47q1
-			local_alpha = asin(local_c / c_deep * sin(alpha_deep));
+	int n = 0;
+	struct BeachNode* curr;
+	for (curr = grid->shoreline; !curr->is_boundary; curr = curr->next)
+	{
+		n++;
+	}
+	if (n > cache->capacity)
+	{
+		cache->chain = realloc(cache->chain, n * sizeof(struct BeachNode*));
+		cache->moved = realloc(cache->moved, n * sizeof(unsigned char));
+		cache->capacity = n;
+	}
 
-			// Determine wave height from refract calcs, from Komar 5.49
-			local_wave_height = wave_height * sqrt(fabs((c_deep * cos(alpha_deep)) / (local_c * 2.0 * n * cos(local_alpha))));
+	n = 0;
+	for (curr = grid->shoreline; !curr->is_boundary; curr = curr->next)
+	{
+		cache->chain[n++] = curr;
+	}
+	return n;
+}
 
-			// wave break condition
-			if (local_wave_height > k_break * local_depth || local_depth <= refract_step)
-			{
-				break;
-			}
-			// iterate
-			local_depth -= refract_step;
+static int GetTransportCacheKey(struct BeachGrid* grid, struct BeachNode* node)
+{
+	return node->is_boundary ? -1 : node->row * grid->cols + node->col;
+}
+
+/**
+ * Transport potential of a node for the wave set on refraction, setting the
+ * node's transport direction. The shadow horizon must be set.
+ */
+static double GetNodeTransportPotential(struct BeachGrid* grid, struct Refraction* refraction, struct BeachNode* node, double wave_angle, double timestep_length, double k)
+{
+	double shore_angle = (*grid).GetAngleByDifferencingScheme(grid, node, wave_angle);
+	double alpha_deep = fabs(shore_angle - EMPTY_double) < 1 ? PI / 4 : wave_angle - shore_angle;
+
+	if (fabs(alpha_deep) > (0.995 * PI / 2) || (fabs(shore_angle - EMPTY_double) > 1 && fabs(shore_angle) > (PI / 2)))
+	{
+		return 0.0;
+	}
+	return refraction->GetTransportPotential(refraction, alpha_deep, timestep_length, k);
+}
+
+/**
+ * Sediment budget of the shoreline: one pass classifies the flow at each
+ * node, limits the transport potentials to the sediment available and, a
+ * node behind once both of its potentials are final, sums the net volume
+ * change; a second pass moves frac_full. The move waits for the second pass
+ * as the cell behind a later node, read for its supply, may be on the shoreline.
+ * RETURN: largest change of frac_full of a node
+ */
+double SedimentBudget(struct BeachGrid* grid, const struct ClosureDepth* closure_depth)
+{
+	double cell_area = grid->cell_width * grid->cell_length;
+	struct BeachNode* curr;
+	struct BeachNode* last = NULL;
+	FLOW_DIR last_dir = NONE;
+
+	for (curr = grid->shoreline; !curr->is_boundary; curr = curr->next)
+	{
+		struct BeachNode* prev = curr->prev;
+		FLOW_DIR dir = BeachNode.GetFlowDirection(curr);
+		double shore_angle = (*grid).GetNextAngle(grid, curr);
+		double depth = closure_depth->GetDepth(closure_depth, curr->row, shore_angle);
+		curr->properties->closure_depth = depth;
+
+		double volume_available = *curr->frac_full * cell_area * depth;
+		double* cell_behind = GetCellInDir(grid, curr->row, curr->col, GetDir(shore_angle));
+		if (cell_behind && *cell_behind >= 1.0)
+		{
+			volume_available += *cell_behind * cell_area * depth;
 		}
+		LimitToSupply(dir, volume_available, BeachNode.GetTransportPotential(prev), BeachNode.GetTransportPotential(curr),
+			&prev->properties->transport_potential, &curr->properties->transport_potential);
 
-		// sed transport_potential
-		curr->properties->transport_potential = GetTransportVolumePotential(local_alpha, local_wave_height, timestep_length, k);
+		if (last)
+		{
+			last->properties->net_volume_change = GetNetVolumeChange(last_dir, BeachNode.GetTransportPotential(last->prev), BeachNode.GetTransportPotential(last));
+		}
+		last = curr;
+		last_dir = dir;
+	}
+	if (last)
+	{
+		last->properties->net_volume_change = GetNetVolumeChange(last_dir, BeachNode.GetTransportPotential(last->prev), BeachNode.GetTransportPotential(last));
+	}
 
-		curr = curr->next;
+	double max_change = 0.0;
+	for (curr = grid->shoreline; !curr->is_boundary; curr = curr->next)
+	{
+		double net_area_change = curr->properties->net_volume_change / curr->properties->closure_depth;
+		double change = net_area_change / cell_area;
+		*curr->frac_full = *curr->frac_full + change;
+		max_change = fmax(max_change, fabs(change));
+		//if (curr->frac_full < 0.0)
+		//{
+		//	 curr = OopsImEmpty(grid, curr);
+		//}
+		//else if (curr->frac_full > 1.0)
+		//{
+		//	curr = OopsImFull(grid, curr);
+		//}
+	}
+	return max_change;
+}
+
+/**
+ * Cut the potentials out of a node down to the volume available at it,
+ * splitting it between both sides when the flow diverges
+ */
+static void LimitToSupply(FLOW_DIR dir, double volume_available, double prev_potential, double potential, double* prev_limited, double* limited)
+{
+	double volume_needed_left = (dir == LEFT || dir == DIVERGENT) ? prev_potential : 0.0;
+	double volume_needed_right = (dir == RIGHT || dir == DIVERGENT) ? potential : 0.0;
+	double total_volume_needed = volume_needed_left + volume_needed_right;
+
+	if (total_volume_needed > volume_available)
+	{
+		if (dir == DIVERGENT)
+		{
+			*prev_limited = total_volume_needed == 0 ? 0.0 : (volume_needed_left / total_volume_needed) * volume_available;
+			*limited = total_volume_needed == 0 ? 0.0 : (volume_needed_right / total_volume_needed) * volume_available;
+		}
+		else if (dir == RIGHT)
+		{
+			volume_available += prev_potential;
+			*limited = volume_available < potential ? volume_available : potential;
+		}
+		else if (dir == LEFT)
+		{
+			volume_available += potential;
+			*prev_limited = volume_available < prev_potential ? volume_available : prev_potential;
+		}
 	}
 }
 
-double GetTransportVolumePotential(double alpha, double wave_height, double timestep_length, double k)
+// Volume into a node less the volume out of it, from the potentials on either side
+static double GetNetVolumeChange(FLOW_DIR dir, double prev_potential, double potential)
 {
-	int rho = 1020;         // (kg/m^3) density of salt water
-	return fabs(k * rho * pow(GRAVITY, 3.0 / 2.0) * pow(wave_height, 5.0 / 2.0) * cos(alpha) * sin(alpha) * timestep_length);
+	double volume_in = 0.0;
+	double volume_out = 0.0;
+	switch (dir)
+	{
+	case RIGHT:
+		volume_in = prev_potential;
+		volume_out = potential;
+		break;
+	case DIVERGENT:
+		volume_out = potential + prev_potential;
+		break;
+	case CONVERGENT:
+		volume_in = potential + prev_potential;
+		break;
+	case LEFT:
+		volume_in = potential;
+		volume_out = prev_potential;
+		break;
+	default:
+		break;
+	}
+	return volume_in - volume_out;
 }
 
-void GetAvailableSupply(struct BeachGrid* grid, int ref_pos, double ref_depth, double shelf_slope, double shoreface_slope, double min_depth, double depthOfClosure)
+/* ---- ARRAY ENGINE -------
+ * Same transport phases over a Shoreline loaded for the current timestep,
+ * visiting cells by shoreline position instead of following next/prev
+ */
+static int CheckIfInShadowAt(struct Shoreline* shoreline, struct BeachGrid* grid, int i, double wave_angle)
 {
-	double cell_area = g_cell_width * g_cell_length;
+	if (i == 0 || i == shoreline->length + 1)
+	{
+		return FALSE;
+	}
+	if (shoreline->in_shadow[i] == EMPTY_INT)
+	{
+		shoreline->in_shadow[i] = (*grid).CheckIfCellInShadow(grid, shoreline->row[i], shoreline->col[i], shoreline->frac_full[i], wave_angle);
+	}
+	return shoreline->in_shadow[i];
+}
 
-	struct BeachNode* curr = grid->shoreline;
+static double GetAngleByDifferencingSchemeAt(struct Shoreline* shoreline, struct BeachGrid* grid, int i, double wave_angle)
+{
+	int end = shoreline->length + 1;
+	double alpha = wave_angle - shoreline->next_angle[i];
+	int downwind, upwind, calc;
+	double upwind_angle, downwind_angle;
+	if (alpha > 0) // transport going right
+	{
+		calc = i;
+		downwind = i + 1;
+		upwind = i - 1;
+		upwind_angle = shoreline->prev_angle[calc];
+		downwind_angle = shoreline->next_angle[calc];
+		shoreline->transport_dir[i] = RIGHT;
+	}
+	else
+	{
+		calc = i + 1;
+		downwind = i;
+		upwind = calc == end ? calc : calc + 1;
+		upwind_angle = shoreline->next_angle[calc];
+		downwind_angle = shoreline->prev_angle[calc];
+		shoreline->transport_dir[i] = LEFT;
+	}
 
-	while (!curr->is_boundary)
+	if (CheckIfInShadowAt(shoreline, grid, calc, wave_angle))
 	{
-		double volume_needed_left = 0.0;
-		double volume_needed_right = 0.0;
+		return wave_angle - (PI / 2);
+	}
 
-		struct BeachNode* prev = curr->prev;
+	int downwindInShadow = CheckIfInShadowAt(shoreline, grid, downwind, wave_angle);
+	int upwindInShadow = CheckIfInShadowAt(shoreline, grid, upwind, wave_angle);
+
+	double instability_threshold = 42 * DEG_TO_RAD;
+	int U = fabs(wave_angle - shoreline->surrounding_angle[calc]) >= instability_threshold;
+	int U_downwind = (downwind != 0 && downwind != end) ? (fabs(wave_angle - shoreline->surrounding_angle[downwind]) >= instability_threshold) : U;
+	int U_upwind = (upwind != 0 && upwind != end) ? (fabs(wave_angle - shoreline->surrounding_angle[upwind]) >= instability_threshold) : U;
+
+	if (!U && ((U_downwind && !downwindInShadow) || (U_upwind && !upwindInShadow)))
+	{
+		return EMPTY_double;
+	}
+
+	if (downwindInShadow)
+	{
+		U = TRUE;
+	}
+
+	if (U && upwindInShadow)
+	{
+		return wave_angle - (PI / 2);
+	}
+
+	else if (U)
+	{
+		return upwind_angle;
+	}
+	return downwind_angle;
+}
+
+static FLOW_DIR GetFlowDirectionAt(const struct Shoreline* shoreline, int i)
+{
+	FLOW_DIR next_dir = shoreline->transport_dir[i];
+	FLOW_DIR prev_dir = shoreline->transport_dir[i - 1];
+
+	if (prev_dir == RIGHT)
+	{
+		return next_dir == RIGHT ? RIGHT : CONVERGENT;
+	}
+	else if (prev_dir == LEFT)
+	{
+		return next_dir == RIGHT ? DIVERGENT : LEFT;
+	}
+	return next_dir;
+}
+
+// boundaries report the transport potential of their neighboring cell
+static double GetTransportPotentialAt(const struct Shoreline* shoreline, int i)
+{
+	if (i == 0)
+	{
+		return shoreline->transport_potential[1];
+	}
+	if (i == shoreline->length + 1)
+	{
+		return shoreline->transport_potential[shoreline->length];
+	}
+	return shoreline->transport_potential[i];
+}
+
+// Deep water wave angle to the shore at cell i, 0 where it moves no sediment
+static double GetAlphaDeepAt(struct Shoreline* shoreline, struct BeachGrid* grid, int i, double wave_angle)
+{
+	double shore_angle = GetAngleByDifferencingSchemeAt(shoreline, grid, i, wave_angle);
+	double alpha_deep = fabs(shore_angle - EMPTY_double) < 1 ? PI / 4 : wave_angle - shore_angle;
+
+	if (fabs(alpha_deep) > (0.995 * PI / 2) || (fabs(shore_angle - EMPTY_double) > 1 && fabs(shore_angle) > (PI / 2)))
+	{
+		alpha_deep = 0.0;
+	}
+	return alpha_deep;
+}
+
+void WaveTransformationArrays(struct Shoreline* shoreline, struct BeachGrid* grid, struct Refraction* refraction, double wave_angle, double wave_period, double wave_height, double timestep_length, double k)
+{
+	int i;
+	// shadow flags of the whole shoreline in one pass against the horizon
+	(*grid).SetShadowHorizon(grid, wave_angle);
+	for (i = 1; i <= shoreline->length; i++)
+	{
+		shoreline->in_shadow[i] = (*grid).CheckIfCellInShadow(grid, shoreline->row[i], shoreline->col[i], shoreline->frac_full[i], wave_angle);
+	}
+	(*grid).ClearShadowHorizon(grid);
+
+	for (i = 1; i <= shoreline->length; i++)
+	{
+		shoreline->alpha_deep[i] = GetAlphaDeepAt(shoreline, grid, i, wave_angle);
+	}
+
+	// refract the whole shoreline in one batch
+	refraction->SetWave(refraction, wave_height, wave_period);
+	refraction->GetTransportPotentials(refraction, shoreline->alpha_deep + 1, shoreline->length, timestep_length, k, shoreline->transport_potential + 1);
+}
+
+// Net volume change of cell i and the frac_full it leaves, once its potentials are final; returns the change of frac_full
+static double MoveSedimentAt(struct Shoreline* shoreline, int i, FLOW_DIR dir, double depth, double cell_area)
+{
+	shoreline->net_volume_change[i] = GetNetVolumeChange(dir, GetTransportPotentialAt(shoreline, i - 1), GetTransportPotentialAt(shoreline, i));
+	double net_area_change = shoreline->net_volume_change[i] / depth;
+	double change = net_area_change / cell_area;
+	shoreline->frac_full[i] = shoreline->frac_full[i] + change;
+	return change;
+}
+
+// Volume cell i can supply down to its depth of closure, with the full cell behind it
+static double GetVolumeAvailableAt(const struct Shoreline* shoreline, struct BeachGrid* grid, const struct ClosureDepth* closure_depth, int i, double cell_area, double* depth)
+{
+	double shore_angle = shoreline->next_angle[i];
+	*depth = closure_depth->GetDepth(closure_depth, shoreline->row[i], shore_angle);
 
-		FLOW_DIR dir = (*curr).GetFlowDirection(curr);
-		switch (dir) {
-		case RIGHT:
-			volume_needed_right = curr->GetTransportPotential(curr);
-			break;
-		case DIVERGENT:
-			volume_needed_right = curr->GetTransportPotential(curr);
-			volume_needed_left = prev->GetTransportPotential(prev);
-			break;
-		case CONVERGENT:
-			break;
-		case LEFT:
-			volume_needed_left = prev->GetTransportPotential(prev);
-			break;
+	double volume_available = shoreline->frac_full[i] * cell_area * *depth;
+	double* cell_behind = GetCellInDir(grid, shoreline->row[i], shoreline->col[i], GetDir(shore_angle));
+	if (cell_behind && *cell_behind >= 1.0)
+	{
+		volume_available += *cell_behind * cell_area * *depth;
+	}
+	return volume_available;
+}
+
+/**
+ * SedimentBudget in one pass: frac_full is moved in the arrays, a node
+ * behind the supply, and only reaches the cells read for supply on Store
+ * RETURN: largest change of frac_full of a cell
+ */
+double SedimentBudgetArrays(struct Shoreline* shoreline, struct BeachGrid* grid, const struct ClosureDepth* closure_depth)
+{
+	double cell_area = grid->cell_width * grid->cell_length;
+	double* transport_potential = shoreline->transport_potential;
+	FLOW_DIR last_dir = NONE;
+	double last_depth = 0.0;
+	double max_change = 0.0;
+
+	int i;
+	for (i = 1; i <= shoreline->length; i++)
+	{
+		FLOW_DIR dir = GetFlowDirectionAt(shoreline, i);
+		double depth;
+		double volume_available = GetVolumeAvailableAt(shoreline, grid, closure_depth, i, cell_area, &depth);
+		LimitToSupply(dir, volume_available, GetTransportPotentialAt(shoreline, i - 1), GetTransportPotentialAt(shoreline, i),
+			&transport_potential[i - 1], &transport_potential[i]);
+
+		if (i > 1)
+		{
+			max_change = fmax(max_change, fabs(MoveSedimentAt(shoreline, i - 1, last_dir, last_depth, cell_area)));
 		}
+		last_dir = dir;
+		last_depth = depth;
+	}
+	if (shoreline->length > 0)
+	{
+		max_change = fmax(max_change, fabs(MoveSedimentAt(shoreline, shoreline->length, last_dir, last_depth, cell_area)));
+	}
+	return max_change;
+}
 
-		double total_volume_needed = volume_needed_left + volume_needed_right;
-		double shore_angle = (*grid).GetNextAngle(grid, curr);
-		double depth = depthOfClosure ? depthOfClosure : GetDepthOfClosure(curr, ref_pos, ref_depth, shelf_slope, shoreface_slope, shore_angle, min_depth, g_cell_length);
-		double volume_available = curr->frac_full * cell_area * depth;
-		struct BeachNode* node_behind = GetNodeInDir(grid, curr, GetDir(shore_angle));
-		if (node_behind && node_behind->frac_full >= 1.0)
+/* ---- IMPLICIT BUDGET -------
+ * While every cell sees the waves at a low angle and none is shadowed, the
+ * flux across the border of cells i and i + 1 only depends on the border's
+ * angle, and so on the difference of their frac_full: the explicit budget
+ * is a diffusion, which overfills cells once a step is long enough. The
+ * implicit budget linearizes each border's flux about the current angles
+ * and solves for the changes of frac_full at the end of the step, one
+ * tridiagonal system per step. End cells pass their flux on, as in the
+ * explicit budget, and keep their frac_full.
+ */
+#define IMPLICIT_ANGLE_STEP 1e-4    /* radians either side of a border's deep water angle its flux is differenced over */
+
+// Change of the angle of the border of cells i and i + 1 per unit of frac_full cell i + 1 gains over cell i
+static double GetAngleSlopeAt(const struct Shoreline* shoreline, struct BeachGrid* grid, int i)
+{
+	double rise, run;
+	BeachNode.GetSegment(grid, shoreline->row[i], shoreline->col[i], shoreline->frac_full[i],
+		shoreline->row[i + 1], shoreline->col[i + 1], shoreline->frac_full[i + 1], &rise, &run);
+
+	// GetSegment moves the rise of a segment across columns by the difference, else its run
+	int dR = shoreline->row[i] - shoreline->row[i + 1];
+	int dC = shoreline->col[i + 1] - shoreline->col[i];
+	double rise_slope = dC != 0 ? (dC > 0 ? 1 : -1) * grid->cell_length : 0.0;
+	double run_slope = dC == 0 ? (dR > 0 ? -1 : 1) * grid->cell_width : 0.0;
+	return (run * rise_slope - rise * run_slope) / (rise * rise + run * run);
+}
+
+// Flux in the direction of the shoreline from a potential and the deep water angle it was found for
+static double GetSignedPotential(double alpha_deep, double potential)
+{
+	return alpha_deep > 0 ? potential : -potential;
+}
+
+// Flux across the border of cells i and i + 1 at the start of the step, in the direction of the shoreline
+static double GetFluxAt(const struct Shoreline* shoreline, int i)
+{
+	return shoreline->transport_dir[i] == RIGHT ? shoreline->transport_potential[i] : -shoreline->transport_potential[i];
+}
+
+/**
+ * Sediment budget of the arrays engine by a backward Euler step of the
+ * linearized fluxes, after WaveTransformationArrays or Segments. Falls back
+ * (leaving everything as it was) where that would not hold: a cell in
+ * shadow or at the high angles of the instability, a border whose flux
+ * grows with the difference of frac_full across it, or a cell giving more
+ * than it can supply.
+ * RETURN: 0 with the largest change of frac_full of a cell in max_change, -1 to use the explicit budget
+ */
+int SedimentBudgetImplicit(struct Shoreline* shoreline, struct BeachGrid* grid, const struct ClosureDepth* closure_depth,
+	struct Refraction* refraction, struct ImplicitTransport* implicit, double wave_angle, double timestep_length, double k, double* max_change)
+{
+	int n = shoreline->length;
+	double instability_threshold = 42 * DEG_TO_RAD;
+	int i;
+	for (i = 1; i <= n; i++)
+	{
+		if (shoreline->in_shadow[i] || fabs(wave_angle - shoreline->surrounding_angle[i]) >= instability_threshold)
 		{
-			volume_available += node_behind->frac_full * cell_area * depth;
+			return -1;
 		}
+	}
+	for (i = 1; i < n; i++)
+	{
+		if (fabs(shoreline->next_angle[i]) > PI / 2)
+		{
+			return -1;
+		}
+	}
 
-		if (total_volume_needed > volume_available)
+	implicit->Reserve(implicit, n);
+	double* alpha = implicit->alpha;
+	double* potential = implicit->potential;
+	double* coupling = implicit->coupling;
+	int num_borders = n - 1;
+	if (num_borders > 0)
+	{
+		for (i = 1; i < n; i++)
 		{
-			if (dir == DIVERGENT)
-			{
-				curr->prev->properties->transport_potential = total_volume_needed == 0 ? 0.0 : (volume_needed_left / total_volume_needed) * volume_available;
-				curr->properties->transport_potential = total_volume_needed == 0 ? 0.0 : (volume_needed_right / total_volume_needed) * volume_available;
-			}
-			else if (dir == RIGHT)
-			{
-				volume_available += prev->GetTransportPotential(prev);
-				curr->properties->transport_potential = volume_available < curr->GetTransportPotential(curr) ? volume_available : curr->GetTransportPotential(curr);
-			}
-			else if (dir == LEFT)
-			{
-				volume_available += curr->GetTransportPotential(curr);
-				prev->properties->transport_potential = volume_available < prev->GetTransportPotential(prev) ? volume_available : prev->GetTransportPotential(prev);
-			}
+			alpha[2 * i - 2] = shoreline->alpha_deep[i] + IMPLICIT_ANGLE_STEP;
+			alpha[2 * i - 1] = shoreline->alpha_deep[i] - IMPLICIT_ANGLE_STEP;
+		}
+		refraction->GetTransportPotentials(refraction, alpha, 2 * num_borders, timestep_length, k, potential);
+	}
+	for (i = 1; i < n; i++)
+	{
+		double flux_slope = (GetSignedPotential(alpha[2 * i - 2], potential[2 * i - 2])
+			- GetSignedPotential(alpha[2 * i - 1], potential[2 * i - 1])) / (2 * IMPLICIT_ANGLE_STEP);
+		// the deep water angle falls as the border's angle rises
+		coupling[i] = -flux_slope * GetAngleSlopeAt(shoreline, grid, i);
+		if (coupling[i] > 0)
+		{
+			return -1;
 		}
+	}
 
-		curr = curr->next;
+	// row i: depth * cell_area * change[i] = flux in - flux out at the end of the step
+	double cell_area = grid->cell_width * grid->cell_length;
+	double* diag = implicit->diag;
+	double* rhs = implicit->rhs;
+	double* change = implicit->change;
+	for (i = 2; i < n; i++)
+	{
+		implicit->volume_available[i] = GetVolumeAvailableAt(shoreline, grid, closure_depth, i, cell_area, &implicit->depth[i]);
+		diag[i] = implicit->depth[i] * cell_area - coupling[i - 1] - coupling[i];
+		rhs[i] = GetFluxAt(shoreline, i - 1) - GetFluxAt(shoreline, i);
+	}
+	for (i = 3; i < n; i++)
+	{
+		double w = coupling[i - 1] / diag[i - 1];
+		diag[i] -= w * coupling[i - 1];
+		rhs[i] -= w * rhs[i - 1];
 	}
+	change[1] = change[n] = 0.0;
+	for (i = n - 1; i >= 2; i--)
+	{
+		change[i] = (rhs[i] - (i < n - 1 ? coupling[i] * change[i + 1] : 0.0)) / diag[i];
+		if (-change[i] * implicit->depth[i] * cell_area > implicit->volume_available[i])
+		{
+			return -1;
+		}
+	}
+
+	*max_change = 0.0;
+	for (i = 1; i <= n; i++)
+	{
+		shoreline->net_volume_change[i] = (i > 1 && i < n) ? change[i] * implicit->depth[i] * cell_area : 0.0;
+		shoreline->frac_full[i] += change[i];
+		*max_change = fmax(*max_change, fabs(change[i]));
+	}
+	return 0;
 }
 
-void NetVolumeChange(struct BeachGrid* grid)
+/* ---- SEGMENTED ARRAY ENGINE -------
+ * The array engine's phases per segment of the shoreline on a thread pool.
+ * A phase only reads the results of other segments once the phase before it
+ * is over, except where potentials are limited to supply: that carries from
+ * each cell to the next, so a segment starts limiting SEGMENT_HALO cells
+ * early from a guess, and the borders whose guess was off are redone in
+ * order. Results are the serial engine's bit for bit.
+ */
+struct SegmentRun {
+	struct Shoreline* shoreline;
+	struct BeachGrid* grid;
+	struct Refraction* refraction;
+	const struct ClosureDepth* closure_depth;
+	struct TransportSegments* segments;
+	double wave_angle, timestep_length, k, cell_area;
+};
+
+static void GetSegmentCells(const struct Shoreline* shoreline, int segment, int* first, int* last)
 {
-	struct BeachNode* curr = grid->shoreline;
+	*first = 1 + segment * SEGMENT_LENGTH;
+	*last = *first + SEGMENT_LENGTH - 1 < shoreline->length ? *first + SEGMENT_LENGTH - 1 : shoreline->length;
+}
 
-	while (!curr->is_boundary) {
-		double volume_in = 0.0;
-		double volume_out = 0.0;
+static void FindShadowsInSegment(void* args, int segment)
+{
+	struct SegmentRun* run = args;
+	struct Shoreline* shoreline = run->shoreline;
+	int first, last, i;
+	GetSegmentCells(shoreline, segment, &first, &last);
+	for (i = first; i <= last; i++)
+	{
+		shoreline->in_shadow[i] = (*run->grid).FindCellShadow(run->grid, shoreline->row[i], shoreline->col[i], shoreline->frac_full[i],
+			run->wave_angle, &run->segments->shadow_kept[i]);
+	}
+}
 
-		struct BeachNode* prev = curr->prev;
+static void TransformWavesInSegment(void* args, int segment)
+{
+	struct SegmentRun* run = args;
+	struct Shoreline* shoreline = run->shoreline;
+	int first, last, i;
+	GetSegmentCells(shoreline, segment, &first, &last);
+	for (i = first; i <= last; i++)
+	{
+		shoreline->alpha_deep[i] = GetAlphaDeepAt(shoreline, run->grid, i, run->wave_angle);
+	}
+	run->refraction->GetTransportPotentials(run->refraction, shoreline->alpha_deep + first, last - first + 1,
+		run->timestep_length, run->k, shoreline->transport_potential + first);
+}
+
+void WaveTransformationSegments(struct Shoreline* shoreline, struct BeachGrid* grid, struct Refraction* refraction, struct TransportSegments* segments,
+	double wave_angle, double wave_period, double wave_height, double timestep_length, double k)
+{
+	struct SegmentRun run = {
+		.shoreline = shoreline,
+		.grid = grid,
+		.refraction = refraction,
+		.segments = segments,
+		.wave_angle = wave_angle,
+		.timestep_length = timestep_length,
+		.k = k
+	};
+	segments->Reserve(segments, shoreline->length);
+
+	// the shadow cache only takes the thresholds found once every segment is done
+	(*grid).SetShadowHorizon(grid, wave_angle);
+	segments->pool->Run(segments->pool, &FindShadowsInSegment, &run, segments->num_segments);
+	int i;
+	for (i = 1; i <= shoreline->length; i++)
+	{
+		(*grid).KeepCellShadow(grid, &segments->shadow_kept[i]);
+	}
+	(*grid).ClearShadowHorizon(grid);
+
+	refraction->SetWave(refraction, wave_height, wave_period);
+	segments->pool->Run(segments->pool, &TransformWavesInSegment, &run, segments->num_segments);
+}
+
+static int IsSameDouble(double a, double b)
+{
+	return memcmp(&a, &b, sizeof(double)) == 0;
+}
 
-		FLOW_DIR dir = (*curr).GetFlowDirection(curr);
-		switch (dir)
+/**
+ * Limit the potentials of a segment's cells to their supply, carrying on
+ * from the halo before it. The halo's first cell takes the potential before
+ * it as not limited, which the halo nearly always forgets: a cell that
+ * limits nothing passes on its own potential.
+ */
+static void LimitSegmentToSupply(void* args, int segment)
+{
+	struct SegmentRun* run = args;
+	struct Shoreline* shoreline = run->shoreline;
+	struct TransportSegments* segments = run->segments;
+	int first, last, i;
+	GetSegmentCells(shoreline, segment, &first, &last);
+
+	int start = first - SEGMENT_HALO > 1 ? first - SEGMENT_HALO : 1;
+	double carried = GetTransportPotentialAt(shoreline, start - 1);
+	for (i = start; i <= last; i++)
+	{
+		FLOW_DIR dir = GetFlowDirectionAt(shoreline, i);
+		double depth;
+		double volume_available = GetVolumeAvailableAt(shoreline, run->grid, run->closure_depth, i, run->cell_area, &depth);
+		double prev_limited = carried;
+		double limited = shoreline->transport_potential[i];
+		LimitToSupply(dir, volume_available, carried, limited, &prev_limited, &limited);
+
+		if (i == first)
 		{
-		case RIGHT:
-			volume_in = prev->GetTransportPotential(prev);
-			volume_out = curr->GetTransportPotential(curr);
-			break;
-		case DIVERGENT:
-			volume_out = curr->GetTransportPotential(curr) + prev->GetTransportPotential(prev);
-			break;
-		case CONVERGENT:
-			volume_in = curr->GetTransportPotential(curr) + prev->GetTransportPotential(prev);
-			break;
-		case LEFT:
-			volume_in = curr->GetTransportPotential(curr);
-			volume_out = prev->GetTransportPotential(prev);
-			break;
+			segments->entry_carried[segment] = carried;
 		}
-		curr->properties->net_volume_change = volume_in - volume_out;
-		curr = curr->next;
+		if (i >= first)
+		{
+			segments->depth[i] = depth;
+			segments->volume_available[i] = volume_available;
+			segments->flow_dir[i] = dir;
+			segments->limited_prev[i] = prev_limited;
+			segments->carried[i] = limited;
+		}
+		carried = limited;
 	}
 }
 
-void TransportSediment(struct BeachGrid* grid, int ref_pos, double ref_depth, double shelf_slope, double shoreface_slope, double min_depth, double depthOfClosure)
+// Redo the cells after each border whose halo guessed wrong, until they carry the same potential as before
+static void ReconcileSegments(struct Shoreline* shoreline, struct TransportSegments* segments)
 {
-	double cell_area = g_cell_width * g_cell_length;
-	struct BeachNode* curr = grid->shoreline;
+	int segment, first, last, i;
+	for (segment = 1; segment < segments->num_segments; segment++)
+	{
+		GetSegmentCells(shoreline, segment, &first, &last);
+		double carried = segments->carried[first - 1];
+		if (IsSameDouble(carried, segments->entry_carried[segment]))
+		{
+			continue;
+		}
+		for (i = first; i <= shoreline->length; i++)
+		{
+			double prev_limited = carried;
+			double limited = shoreline->transport_potential[i];
+			LimitToSupply(segments->flow_dir[i], segments->volume_available[i], carried, limited, &prev_limited, &limited);
+			segments->limited_prev[i] = prev_limited;
+			if (IsSameDouble(limited, segments->carried[i]))
+			{
+				break;
+			}
+			segments->carried[i] = limited;
+			carried = limited;
+		}
+	}
+}
 
-	while (!curr->is_boundary) {
-		double shore_angle = (*grid).GetNextAngle(grid, curr);
-		double depth = depthOfClosure ? depthOfClosure : GetDepthOfClosure(curr, ref_pos, ref_depth, shelf_slope, shoreface_slope, shore_angle, min_depth, g_cell_length);
-		double net_area_change = curr->properties->net_volume_change / depth;
-		curr->frac_full = curr->frac_full + net_area_change / cell_area;
-		//if (curr->frac_full < 0.0)
-		//{
-		//	 curr = OopsImEmpty(grid, curr);
-		//}
-		//else if (curr->frac_full > 1.0)
-		//{
-		//	curr = OopsImFull(grid, curr);
-		//}
-		curr = curr->next;
+// transport_potential[i] once every cell has limited it, boundaries reporting their neighboring cell
+static double GetLimitedPotentialAt(const struct Shoreline* shoreline, const struct TransportSegments* segments, int i)
+{
+	if (i == 0)
+	{
+		i = 1;
 	}
+	return i < shoreline->length ? segments->limited_prev[i + 1] : segments->carried[shoreline->length];
+}
+
+static void MoveSedimentInSegment(void* args, int segment)
+{
+	struct SegmentRun* run = args;
+	struct Shoreline* shoreline = run->shoreline;
+	struct TransportSegments* segments = run->segments;
+	int first, last, i;
+	GetSegmentCells(shoreline, segment, &first, &last);
+	double max_change = 0.0;
+	for (i = first; i <= last; i++)
+	{
+		shoreline->transport_potential[i] = GetLimitedPotentialAt(shoreline, segments, i);
+		shoreline->net_volume_change[i] = GetNetVolumeChange(segments->flow_dir[i], GetLimitedPotentialAt(shoreline, segments, i - 1),
+			GetLimitedPotentialAt(shoreline, segments, i));
+		double net_area_change = shoreline->net_volume_change[i] / segments->depth[i];
+		double change = net_area_change / run->cell_area;
+		shoreline->frac_full[i] = shoreline->frac_full[i] + change;
+		max_change = fmax(max_change, fabs(change));
+	}
+	segments->max_change[segment] = max_change;
+}
+
+double SedimentBudgetSegments(struct Shoreline* shoreline, struct BeachGrid* grid, const struct ClosureDepth* closure_depth, struct TransportSegments* segments)
+{
+	struct SegmentRun run = {
+		.shoreline = shoreline,
+		.grid = grid,
+		.closure_depth = closure_depth,
+		.segments = segments,
+		.cell_area = grid->cell_width * grid->cell_length
+	};
+	segments->Reserve(segments, shoreline->length);
+
+	segments->pool->Run(segments->pool, &LimitSegmentToSupply, &run, segments->num_segments);
+	ReconcileSegments(shoreline, segments);
+	segments->pool->Run(segments->pool, &MoveSedimentInSegment, &run, segments->num_segments);
+
+	double max_change = 0.0;
+	int segment;
+	for (segment = 0; segment < segments->num_segments; segment++)
+	{
+		max_change = fmax(max_change, segments->max_change[segment]);
+	}
+	return max_change;
 }
 
 void OopsImEmpty(struct BeachGrid* grid, struct BeachNode* node)
 {
-	if (node->frac_full >= -0.000001)
+	if (*node->frac_full >= -0.000001)
 	{
-		node->frac_full = 0.0;
+		*node->frac_full = 0.0;
 		return;
-		//return (*grid).ReplaceNode(grid, node);
 	}
-	struct BeachNode** neighbors = (*grid).Get4Neighbors(grid, node);
+	double* neighbors[4];
+	(*grid).Get4Neighbors(grid, node, neighbors);
 
 	int num_cells = 0;
 	double total_sed = 0.0;
@@ -217,40 +853,33 @@ void OopsImEmpty(struct BeachGrid* grid, struct BeachNode* node)
 
 	for (i = 0; i < 4; i++)
 	{
-		if (neighbors[i] && neighbors[i]->frac_full > 0.0)
+		if (*neighbors[i] > 0.0)
 		{
 			num_cells++;
-			total_sed += neighbors[i]->frac_full;
+			total_sed += *neighbors[i];
 		}
 	}
 
 	for (i = 0; i < 4; i++)
 	{
-		struct BeachNode* neighbor = neighbors[i];
-		if (neighbor && neighbor->frac_full > 0.0)
+		if (*neighbors[i] > 0.0)
 		{
-			double percent_available = neighbor->frac_full / total_sed;
-			double delta_fill = node->frac_full * percent_available;
-			neighbor->frac_full += delta_fill;
-			if (neighbor->is_boundary) {
-				free(neighbor->properties);
-				free(neighbor);
-			}
+			double percent_available = *neighbors[i] / total_sed;
+			double delta_fill = *node->frac_full * percent_available;
+			*neighbors[i] += delta_fill;
 		}
 	}
 
 	if (num_cells > 0)
 	{
-		node->frac_full = 0;
+		*node->frac_full = 0;
 	}
-	free(neighbors);
-
-	//return (*grid).ReplaceNode(grid, node);
 }
 
 void OopsImFull(struct BeachGrid* grid, struct BeachNode* node)
 {
-	struct BeachNode** neighbors = (*grid).Get4Neighbors(grid, node);
+	double* neighbors[4];
+	(*grid).Get4Neighbors(grid, node, neighbors);
 
 	int num_cells = 0;
 	double total_space = 0.0;
@@ -258,60 +887,105 @@ void OopsImFull(struct BeachGrid* grid, struct BeachNode* node)
 
 	for (i = 0; i < 4; i++)
 	{
-		if (neighbors[i] && neighbors[i]->frac_full < 1.0)
+		if (*neighbors[i] < 1.0)
 		{
 			num_cells++;
-			total_space += (1 - neighbors[i]->frac_full);
+			total_space += (1 - *neighbors[i]);
 		}
 	}
 
 	for (i = 0; i < 4; i++)
 	{
-		struct BeachNode* neighbor = neighbors[i];
-		if (neighbor && neighbor->frac_full < 1.0)
+		if (*neighbors[i] < 1.0)
 		{
-			double percent_available = (1 - neighbor->frac_full) / total_space;
-			double delta_fill = (node->frac_full - 1) * percent_available;
-			neighbor->frac_full += delta_fill;
-			if (neighbor->is_boundary) {
-				free(neighbor->properties);
-				free(neighbor);
-			}
+			double percent_available = (1 - *neighbors[i]) / total_space;
+			double delta_fill = (*node->frac_full - 1) * percent_available;
+			*neighbors[i] += delta_fill;
 		}
 	}
 
 	if (num_cells > 0)
 	{
-		node->frac_full = 1;
+		*node->frac_full = 1;
 	}
+}
 
-	free(neighbors);
+/* A node and its 4 neighbors, the cells a fix moves sand between */
+static const int FIX_ROWS[5] = { 0, 0, 1, 0, -1 };
+static const int FIX_COLS[5] = { 0, -1, 0, 1, 0 };
 
-	//return (*grid).ReplaceNode(grid, node);
+// the cells around node holding sand, a bit each, to tell which ones a fix moved across 0
+static int GetSandMask(struct BeachGrid* grid, struct BeachNode* node)
+{
+	int mask = 0;
+	int k;
+	for (k = 0; k < 5; k++)
+	{
+		double* cell = (*grid).TryGetCell(grid, node->row + FIX_ROWS[k], node->col + FIX_COLS[k]);
+		if (cell && *cell != 0)
+		{
+			mask |= 1 << k;
+		}
+	}
+	return mask;
 }
 
-void FixBeach(struct BeachGrid* grid)
+// mark the cells around node whose bit of the sand mask changed since mask was taken
+static void MarkCrossings(struct BeachGrid* grid, struct BeachNode* node, int mask)
+{
+	int crossed = mask ^ GetSandMask(grid, node);
+	int k;
+	for (k = 0; k < 5; k++)
+	{
+		if (crossed & (1 << k))
+		{
+			(*grid).MarkCrossing(grid, node->row + FIX_ROWS[k], node->col + FIX_COLS[k]);
+		}
+	}
+}
+
+/**
+ * Move sand out of over- and under-filled cells and smooth corners until
+ * nothing changes. Each pass that changes anything repairs the shoreline
+ * around the cells it moved across 0.
+ * RETURN: 0 on success, -1 if the shoreline could not be traced again,
+ *   leaving the grid without one
+ */
+int FixBeach(struct BeachGrid* grid)
 {
 	struct BeachNode* curr;
+	if (!grid->shoreline)
+	{
+		return -1;
+	}
 	while (TRUE) {
 		int done = TRUE;
 		curr = grid->shoreline;
 		// pass for under-filled cells
 		while (!curr->is_boundary)
 		{
-			if (curr->frac_full < 0.0) {
+			if (*curr->frac_full < 0.0) {
+				int sand = GetSandMask(grid, curr);
 				OopsImEmpty(grid, curr);
+				MarkCrossings(grid, curr, sand);
 				done = FALSE;
 			}
+			else if (*curr->frac_full == 0.0)
+			{
+				// emptied by transport, off the shoreline at the next repair
+				(*grid).MarkCrossing(grid, curr->row, curr->col);
+			}
 			curr = curr->next;
 		}
 		curr = grid->shoreline;
 		// pass for over-filled cells
 		while (!curr->is_boundary)
 		{
-			if (curr->frac_full > 1.0)
+			if (*curr->frac_full > 1.0)
 			{
+				int sand = GetSandMask(grid, curr);
 				OopsImFull(grid, curr);
+				MarkCrossings(grid, curr, sand);
 				done = FALSE;
 			}
 			curr = curr->next;
@@ -321,50 +995,43 @@ void FixBeach(struct BeachGrid* grid)
 		// smooth outset corners
 		while (!curr->is_boundary)
 		{
-			struct BeachNode** neighbors = (*grid).Get4Neighbors(grid, curr);
+			double* neighbors[4];
+			(*grid).Get4Neighbors(grid, curr, neighbors);
 
 			double total_space = 0.0;
 			int needs_fix = TRUE;
 			int j;
 			for (j = 0; j < 4; j++)
 			{
-				if (!neighbors[j]) { continue; }
-				if (neighbors[j]->frac_full >= 1.0)
+				if (*neighbors[j] >= 1.0)
 				{
 					needs_fix = FALSE;
 					break;
 				}
-				else if (neighbors[j]->frac_full > 0.0)
+				else if (*neighbors[j] > 0.0)
 				{
-					total_space += (1 - neighbors[j]->frac_full);
+					total_space += (1 - *neighbors[j]);
 				}
 			}
 
 			if (needs_fix && total_space > 0)
 			{
 				// distribute to beach neighbors
-				double delta_fill = curr->frac_full;
-				curr->frac_full = 0;
+				int sand = GetSandMask(grid, curr);
+				double delta_fill = *curr->frac_full;
+				*curr->frac_full = 0;
 				done = FALSE;
 				for (j = 0; j < 4; j++)
 				{
-					struct BeachNode* neighbor = neighbors[j];
-					if (!neighbor) { continue; }
-					if (neighbor->frac_full < 1.0 && neighbor->frac_full > 0.0)
+					if (*neighbors[j] < 1.0 && *neighbors[j] > 0.0)
 					{
-						if (neighbor->is_boundary) {
-							free(neighbor->properties);
-							free(neighbor);
-						}
-						else {
-							double percent_fill = delta_fill * ((1 - neighbor->frac_full) / total_space);
-							neighbor->frac_full += percent_fill;
-						}
+						double percent_fill = delta_fill * ((1 - *neighbors[j]) / total_space);
+						*neighbors[j] += percent_fill;
 					}
 				}
+				MarkCrossings(grid, curr, sand);
 			}
 			curr = curr->next;
-			free(neighbors);
 		}
 		// remove inset corners
 		curr = grid->shoreline;
@@ -376,83 +1043,58 @@ void FixBeach(struct BeachGrid* grid)
 			if (dist < 2 && dist > 1)
 			{
 				// check if inset or outset: if inset, other cell between prev and next will be empty
-				int other_row = abs(next->GetRow(next) - curr->GetRow(curr)) > 0 ? next->GetRow(next) : prev->GetRow(prev);
-				int other_col = abs(next->GetCol(next) - curr->GetCol(curr)) > 0 ? next->GetCol(next) : prev->GetCol(prev);
-				struct BeachNode* temp = (*grid).TryGetNode(grid, other_row, other_col);
-				if (!temp || temp->frac_full > 0)
+				int other_row = abs(BeachNode.GetRow(next, grid) - BeachNode.GetRow(curr, grid)) > 0 ? BeachNode.GetRow(next, grid) : BeachNode.GetRow(prev, grid);
+				int other_col = abs(BeachNode.GetCol(next, grid) - BeachNode.GetCol(curr, grid)) > 0 ? BeachNode.GetCol(next, grid) : BeachNode.GetCol(prev, grid);
+				double* temp = (*grid).TryGetCell(grid, other_row, other_col);
+				if (!temp || *temp > 0)
 				{
 					curr = curr->next;
 					continue;
 				}
 
 				done = FALSE;
-				struct BeachNode** neighbors = (*grid).Get4Neighbors(grid, curr);
+				double* neighbors[4];
+				(*grid).Get4Neighbors(grid, curr, neighbors);
 				double total_sed = 0.0;
 				int j;
 				for (j = 0; j < 4; j++)
 				{
-					if (!neighbors[j]) { continue; }
-					if (neighbors[j]->frac_full > 0.0 && neighbors[j]->frac_full < 1.0)
+					if (*neighbors[j] > 0.0 && *neighbors[j] < 1.0)
 					{
-						total_sed += neighbors[j]->frac_full;
+						total_sed += *neighbors[j];
 					}
 				}
 
 				// distribute to beach neighbors
 				if (total_sed > 0)
 				{
-					double delta_fill = min(1 - curr->frac_full, total_sed);
-					curr->frac_full += delta_fill;
+					int sand = GetSandMask(grid, curr);
+					double delta_fill = fmin(1 - *curr->frac_full, total_sed);
+					*curr->frac_full += delta_fill;
 					for (j = 0; j < 4; j++)
 					{
-						struct BeachNode* neighbor = neighbors[j];
-						if (!neighbor) { continue; }
-						if (neighbor->frac_full < 1.0 && neighbor->frac_full > 0.0)
+						if (*neighbors[j] < 1.0 && *neighbors[j] > 0.0)
 						{
-							double percent_fill = delta_fill * (neighbor->frac_full / total_sed);
-							neighbor->frac_full -= percent_fill;
-							if (neighbor->is_boundary) {
-								free(neighbor->properties);
-								free(neighbor);
-							}
+							double percent_fill = delta_fill * (*neighbors[j] / total_sed);
+							*neighbors[j] -= percent_fill;
 						}
 					}
-					
-					free(neighbors);
+					MarkCrossings(grid, curr, sand);
 				}
 			}
 			curr = curr->next;
 		}
 		if (done) { break; }
-		grid->FindBeach(grid);
+		if (grid->RepairShoreline(grid) < 0)
+		{
+			return -1;
+		}
 	}
-
+	return 0;
 }
 
 
 /* ---- SEDIMENT TRANSPORT HELPERS ------- */
-double GetDepthOfClosure(struct BeachNode* node, int ref_pos, double shelf_depth_at_ref_pos, double shelf_slope, double shoreface_slope, double shore_angle, double min_shelf_depth_at_closure, int cell_length)
-{
-	int x = node->row;
-	// Eq 1
-	double local_shelf_depth = shelf_depth_at_ref_pos + ((ref_pos - x) * cell_length * shelf_slope);
-
-	// Eq 2
-	double cross_shore_distance_to_closure = local_shelf_depth / (shoreface_slope - (cos(shore_angle) * shelf_slope));
-
-	// Eq 3
-	double cross_shore_pos_of_closure = x + cos(shore_angle) * cross_shore_distance_to_closure / cell_length;
-
-	// Eq 4
-	double closure_depth = shelf_depth_at_ref_pos + (cross_shore_pos_of_closure - ref_pos) * cell_length * shelf_slope;
-	if (closure_depth < min_shelf_depth_at_closure)
-	{
-		closure_depth = min_shelf_depth_at_closure;
-	}
-
-	return closure_depth;
-}
-
 double ModTowardZero(double a, double m)
 {
 	int sign = a / fabs(a);
@@ -487,11 +1129,8 @@ double GetDir(double shore_angle)
 	return RoundRadians(shore_normal, PI / 2, PI / 6);
 }
 
-struct BeachNode* GetNodeInDir(struct BeachGrid* grid, struct BeachNode* node, double dir)
+double* GetCellInDir(struct BeachGrid* grid, int r, int c, double dir)
 {
-	int r = node->row;
-	int c = node->col;
-
 	int row, col;
 
 	if (cos(dir) > 1e-6)
@@ -520,6 +1159,6 @@ struct BeachNode* GetNodeInDir(struct BeachGrid* grid, struct BeachNode* node, d
 		row = r;
 	}
 
-	return (*grid).TryGetNode(grid, row, col);
+	return (*grid).TryGetCell(grid, row, col);
 }
 
@@ -8,12 +8,29 @@ extern "C" {
 #include <stdlib.h>
 #include "BeachNode.h"
 #include "BeachGrid.h"
+#include "Shoreline.h"
+#include "Refraction.h"
+#include "ClosureDepth.h"
+#include "TransportSegments.h"
+#include "ImplicitTransport.h"
 
-void WaveTransformation(struct BeachGrid *grid, double wave_angle, double wave_period, double wave_height, double timestep_length, double k);
-void GetAvailableSupply(struct BeachGrid *grid, int ref_pos, double ref_depth, double shelf_slope, double shoreface_slope, double min_depth, double depthOfClsoure);
-void NetVolumeChange(struct BeachGrid *grid);
-void TransportSediment(struct BeachGrid *grid, int ref_pos, double ref_depth, double shelf_slope, double shoreface_slope, double min_depth, double depthOfClosure);
-void FixBeach(struct BeachGrid* grid);
+void WaveTransformation(struct BeachGrid *grid, struct Refraction *refraction, double wave_angle, double wave_period, double wave_height, double timestep_length, double k);
+double SedimentBudget(struct BeachGrid *grid, const struct ClosureDepth *closure_depth);
+int FixBeach(struct BeachGrid* grid);
+
+/* Array engine: the transport phases over a Shoreline, FixBeach still runs on the grid.
+   The budgets return the largest change of frac_full of a shoreline cell */
+void WaveTransformationArrays(struct Shoreline* shoreline, struct BeachGrid* grid, struct Refraction* refraction, double wave_angle, double wave_period, double wave_height, double timestep_length, double k);
+double SedimentBudgetArrays(struct Shoreline* shoreline, struct BeachGrid* grid, const struct ClosureDepth* closure_depth);
+
+/* Array engine: the budget as a tridiagonal solve on low angle, unshadowed steps, -1 (nothing changed) otherwise */
+int SedimentBudgetImplicit(struct Shoreline* shoreline, struct BeachGrid* grid, const struct ClosureDepth* closure_depth,
+	struct Refraction* refraction, struct ImplicitTransport* implicit, double wave_angle, double timestep_length, double k, double* max_change);
+
+/* Array engine with the shoreline cut into segments run on a thread pool, same results */
+void WaveTransformationSegments(struct Shoreline* shoreline, struct BeachGrid* grid, struct Refraction* refraction, struct TransportSegments* segments,
+	double wave_angle, double wave_period, double wave_height, double timestep_length, double k);
+double SedimentBudgetSegments(struct Shoreline* shoreline, struct BeachGrid* grid, const struct ClosureDepth* closure_depth, struct TransportSegments* segments);
 
 #if defined(__cplusplus)
 }
@@ -21,14 +21,3 @@ void free2d(void **mem)
   free(mem[0]);
   free(mem);
 }
-
-/**
- * Generates a random number equally distributed between zero and one
- * PARAMETERS: none
- * RETURN: random double between zero and one
- */
-double RandZeroToOne(void)
-{
-	return (double)rand() / RAND_MAX;
-}
-
@@ -6,10 +6,46 @@ extern "C" {
 #endif
 
 #include <stdlib.h>
+#include <stdint.h>
 
 void **malloc2d(size_t n_rows, size_t n_cols, size_t itemsize);
 void free2d(void **mem);
-double RandZeroToOne(void);
+
+/**
+ * Philox4x32-10 counter-based generator (Salmon et al. 2011): maps a
+ * (counter, key) pair to four independent uniform 32 bit words, so any
+ * draw of a stream can be computed directly without sequential state.
+ * Inline so bulk fills over a counter range can be unrolled/vectorized.
+ */
+static inline void Philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4])
+{
+	uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+	uint32_t k0 = key[0], k1 = key[1];
+	int i;
+	for (i = 0; i < 10; i++)
+	{
+		uint64_t p0 = (uint64_t)0xD2511F53u * c0;
+		uint64_t p1 = (uint64_t)0xCD9E8D57u * c2;
+		uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+		uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+		c1 = (uint32_t)p1;
+		c3 = (uint32_t)p0;
+		c0 = n0;
+		c2 = n2;
+		k0 += 0x9E3779B9u;
+		k1 += 0xBB67AE85u;
+	}
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+/* Map a 32 bit word to a double equally distributed between zero and one */
+static inline double RandWordToUnit(uint32_t word)
+{
+	return word * (1.0 / 4294967295.0);
+}
 
 #if defined(__cplusplus)
 }
@@ -4,46 +4,94 @@
 
 #include "cem_interface.h"
 #include "cem/config.h"
+#include "cem/Refraction.h"
 
-int run_test(Config config, int numTimesteps, int saveInterval);
-int cem_initialize(Config config);
-double* cem_update(int saveInterval);
-int cem_finalize(void);
+void test_LogShoreline(CemModel* model);
+void test_OutputGrid(CemModel* model);
 
-void test_LogShoreline();
-void test_OutputGrid();
+/* Model behind the single-run initialize/update/finalize exports */
+static CemModel* default_model = NULL;
 
 int run_test(Config config, int numTimesteps, int saveInterval)
 {
-	if (cem_initialize(config) != 0) { return FAILURE; }
-	test_LogShoreline();
+	CemModel* model = cem_create(config);
+	if (!model) { return FAILURE; }
+	test_LogShoreline(model);
 	int i = 0;
 	while (i < numTimesteps)
 	{
 		printf("%d\n", i);
 		int steps = (i + saveInterval) < numTimesteps ? saveInterval: (numTimesteps - i);
-		double* out = cem_update(steps);
-		test_OutputGrid();
+		double* out = cem_update(model, steps);
+		test_OutputGrid(model);
 		i += saveInterval;
 	}
-	if (cem_finalize(config) != 0) { return FAILURE; }
+	if (cem_destroy(model) != 0) { return FAILURE; }
 	return SUCCESS;
 }
 
 int initialize(Config config) {
-	int status = cem_initialize(config);
+	if (default_model)
+	{
+		cem_destroy(default_model);
+	}
+	default_model = cem_create(config);
 
-	if (status == 0)
+	if (default_model)
 		return SUCCESS;
 	else
 		return FAILURE;
 }
 
 double* update(int saveInterval) {
-	return cem_update(saveInterval);
+	return cem_update(default_model, saveInterval);
+}
+
+int step(int numSteps) {
+	if (cem_step(default_model, numSteps) != 0)
+		return FAILURE;
+	return SUCCESS;
+}
+
+// Live grid of the default model, valid until finalize
+CemRaster raster() {
+	return cem_get_raster(default_model);
 }
 
 int finalize() {
-	cem_finalize();
+	cem_destroy(default_model);
+	default_model = NULL;
+	return SUCCESS;
+}
+
+int save_checkpoint(const char* path) {
+	if (cem_save_checkpoint(default_model, path) != 0)
+		return FAILURE;
+	return SUCCESS;
+}
+
+// Replace the default model with one restored from a checkpoint
+int load_checkpoint(Config config, const char* path) {
+	CemModel* model = cem_load_checkpoint(config, path);
+	if (!model)
+		return FAILURE;
+
+	cem_destroy(default_model);
+	default_model = model;
+	return SUCCESS;
+}
+
+// Transport potentials of a wave breaking from each alphaDeep, for unit k and
+// timestep, in a refraction mode; kernelWidth > 0 picks the march kernel of
+// REFRACTION_VECTOR (see UseMarchKernel)
+int transport_potentials(int refraction, int kernelWidth, double waveHeight, double wavePeriod,
+	const double* alphaDeep, int count, double* potentials) {
+	struct Refraction waves = Refraction.new(refraction, 0);
+	if (kernelWidth > 0 && waves.UseMarchKernel(&waves, kernelWidth) != 0)
+		return FAILURE;
+
+	waves.SetWave(&waves, waveHeight, wavePeriod);
+	waves.GetTransportPotentials(&waves, alphaDeep, count, 1.0, 1.0, potentials);
+	Refraction.free(&waves);
 	return SUCCESS;
 }
@@ -11,11 +11,18 @@ extern "C" {
 
 #include "cem_EXPORTS.h"
 #include "cem/config.h"
+#include "cem/cem.h"
 
 cem_EXPORT int run_test(Config config, int numTimesteps, int saveInterval);
 cem_EXPORT int initialize(Config config);
 cem_EXPORT double* update(int saveInterval);
+cem_EXPORT int step(int numSteps);
+cem_EXPORT CemRaster raster();
 cem_EXPORT int finalize();
+cem_EXPORT int save_checkpoint(const char* path);
+cem_EXPORT int load_checkpoint(Config config, const char* path);
+cem_EXPORT int transport_potentials(int refraction, int kernelWidth, double waveHeight, double wavePeriod,
+	const double* alphaDeep, int count, double* potentials);
 
 #if defined(__cplusplus)
 }
@@ -23,4 +23,25 @@ class Config(Structure):
         ("sedMobility", c_double),
         ("lengthTimestep", c_double),
         ("numTimesteps", c_int),
-        ("saveInterval", c_int)]
\ No newline at end of file
+        ("saveInterval", c_int),
+        ("engine", c_int),
+        ("refraction", c_int),
+        ("breakingTolerance", c_double),
+        ("incremental", c_int),
+        ("incrementalTolerance", c_double),
+        ("closureDepth", c_int),
+        ("closureDepthBins", c_int),
+        ("transportThreads", c_int),
+        ("adaptiveTimestep", c_int),
+        ("maxCellChange", c_double),
+        ("morphologicalFactor", c_int),
+        ("waveAngleBins", c_int),
+        ("waveHeightBins", c_int),
+        ("implicitTransport", c_int)]
+# live view of the CEM grid returned by lib.raster: cell (r, c) is data[r*rowStride + c]
+class Raster(Structure):
+    _fields_ = [
+        ("data", POINTER(c_double)),
+        ("nRows", c_int),
+        ("nCols", c_int),
+        ("rowStride", c_int)]
@@ -0,0 +1,137 @@
+from ctypes import *
+from multiprocessing import Process, Queue
+import math
+import os
+import tempfile
+
+import sys
+sys.path.append('..')
+from server.pyfiles import config
+
+# Saves a checkpoint halfway through a run, restores it in a fresh process and
+# steps on, then checks the shoreline against the run left uninterrupted, for
+# each engine and the options that keep state across steps. Each run has its
+# own process with a time limit, so a run that crashes or hangs after the
+# restore is reported as such.
+# usage: python checkpoint_test.py [library path]
+
+lib_path = sys.argv[1] if len(sys.argv) > 1 else "../server/C/_build/py_cem"
+
+#### create basic input variables ####
+nRows = 40
+nCols = 80
+numTimesteps = 400
+timeLimit = 120
+# wave heights, angles and periods, one per timestep in turn
+waves = ([0.7, 0.4, 0.3, 0.6, 0.5, 0.2, 0.5, 0.8], [0, 0.3, -0.2, 0.5, -0.4, 0.1, 0.2, -0.3], [8, 6, 6, 9, 7, 5, 8, 10])
+# the same wave every timestep, so the transport cache is reused
+steady = ([0.6], [0.3], [8])
+options = [
+    ("linked list", dict(engine = 0)),
+    ("arrays", dict(engine = 1)),
+    ("linked list stochastic", dict(engine = 0, asymmetry = 0.45, stability = 0.65)),
+    ("arrays stochastic", dict(engine = 1, asymmetry = 0.45, stability = 0.65)),
+    ("linked list incremental", dict(engine = 0, incremental = 1, waves = steady)),
+    ("linked list incremental 1e-2", dict(engine = 0, incremental = 1, incrementalTolerance = 1e-2, waves = steady)),
+    ("linked list adaptive", dict(engine = 0, adaptiveTimestep = 1)),
+    ("arrays adaptive", dict(engine = 1, adaptiveTimestep = 1)),
+    ("linked list morph", dict(engine = 0, morphologicalFactor = 5)),
+    ("arrays morph", dict(engine = 1, morphologicalFactor = 5)),
+    ("arrays adaptive morph", dict(engine = 1, adaptiveTimestep = 1, morphologicalFactor = 5)),
+    ("arrays implicit", dict(engine = 1, implicitTransport = 1, lengthTimestep = 5))]
+
+# coast with a few bumps in it, land at the high rows
+def make_grid():
+    grid = ((POINTER(c_double)) * nRows)()
+    for r in range(nRows):
+        grid[r] = (c_double * nCols)()
+        for c in range(nCols):
+            shore = nRows // 3 + 0.5 + 1.5 * math.sin(2 * math.pi * c / 20)
+            grid[r][c] = min(1.0, max(0.0, r + 1 - shore))
+    return grid
+
+def load_lib():
+    lib = CDLL(lib_path)
+    lib.initialize.argtypes = [config.Config]
+    lib.initialize.restype = c_int
+    lib.step.argtypes = [c_int]
+    lib.step.restype = c_int
+    lib.raster.restype = config.Raster
+    lib.finalize.restype = c_int
+    lib.save_checkpoint.argtypes = [c_char_p]
+    lib.save_checkpoint.restype = c_int
+    lib.load_checkpoint.argtypes = [config.Config, c_char_p]
+    lib.load_checkpoint.restype = c_int
+    return lib
+
+def make_config(option):
+    option = dict(option)
+    heights, angles, periods = option.pop("waves", waves)
+    inputs = dict(grid = make_grid(), waveHeights = (c_double * len(heights))(*heights),
+            waveAngles = (c_double * len(angles))(*angles), wavePeriods = (c_double * len(periods))(*periods),
+            asymmetry = -1, stability = -1, numWaveInputs = len(heights),
+            nRows = nRows, nCols = nCols, cellWidth = 100, cellLength = 100,
+            shelfSlope = 0.001, shorefaceSlope = 0.01, crossShoreReferencePos = 10,
+            shelfDepthAtReferencePos = 10, minimumShelfDepthAtClosure = 10, depthOfClosure = 10,
+            sedMobility = 1, lengthTimestep = 1, saveInterval = numTimesteps, numTimesteps = numTimesteps)
+    inputs.update(option)
+    return config.Config(**inputs)
+
+def get_raster(lib):
+    raster = lib.raster()
+    return [raster.data[r * raster.rowStride + c] for r in range(nRows) for c in range(nCols)]
+
+# run the first half, checkpointing it if a path is given, else the whole run
+def run_first(option, path, queue):
+    lib = load_lib()
+    if lib.initialize(make_config(option)) != 0 or lib.step(numTimesteps // 2) != 0:
+        queue.put(None)
+        return
+    if path:
+        queue.put(lib.save_checkpoint(path.encode()) == 0)
+    else:
+        queue.put(get_raster(lib) if lib.step(numTimesteps - numTimesteps // 2) == 0 else None)
+    lib.finalize()
+
+# restore the checkpoint and run the second half
+def run_restored(option, path, queue):
+    lib = load_lib()
+    if lib.load_checkpoint(make_config(option), path.encode()) != 0 or lib.step(numTimesteps - numTimesteps // 2) != 0:
+        queue.put(None)
+        return
+    queue.put(get_raster(lib))
+    lib.finalize()
+
+# RETURN: what the run put on the queue, "crashed" or "hung"
+def run_isolated(target, option, path):
+    queue = Queue()
+    process = Process(target = target, args = (option, path, queue))
+    process.start()
+    process.join(timeLimit)
+    if process.is_alive():
+        process.terminate()
+        return "hung"
+    return queue.get() if process.exitcode == 0 else "crashed"
+
+if __name__ == "__main__":
+    directory = tempfile.mkdtemp()
+    failures = 0
+    print("run                            result")
+    for name, option in options:
+        path = os.path.join(directory, name.replace(' ', '_') + ".ckpt")
+        whole = run_isolated(run_first, option, None)
+        saved = run_isolated(run_first, option, path)
+        restored = run_isolated(run_restored, option, path) if saved is True else "not saved"
+        if not isinstance(whole, list):
+            result = "uninterrupted run " + str(whole)
+        elif not isinstance(restored, list):
+            result = "restored run " + str(restored)
+        else:
+            diff = max(abs(a - b) for a, b in zip(whole, restored))
+            result = "identical" if diff == 0 else "max |diff| %g" % diff
+        failures += result != "identical"
+        print("%-30s %s" % (name, result))
+        if os.path.exists(path):
+            os.remove(path)
+    os.rmdir(directory)
+    sys.exit(1 if failures else 0)
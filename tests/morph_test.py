@@ -0,0 +1,116 @@
+from ctypes import *
+from multiprocessing import Process, Queue
+import math
+import random
+import time
+import sys
+
+import sys
+sys.path.append('..')
+from server.pyfiles import config
+
+# Compares final shorelines of morphologically accelerated runs, over the
+# condensed daily WIS 63436 record, with the run over the full record. The
+# full record shuffled shows how much the order of the waves alone moves the
+# shoreline, which condensing gives up. Each run has its own process, so a
+# run that crashes is reported as failed like one whose step fails, and the
+# script exits nonzero if any run failed.
+# usage: python morph_test.py [library path] [years]
+
+lib_path = sys.argv[1] if len(sys.argv) > 1 else "../server/C/_build/py_cem"
+years = int(sys.argv[2]) if len(sys.argv) > 2 else 5
+
+#### create basic input variables ####
+nRows = 60
+nCols = 200
+cellWidth = 300
+cellLength = 300
+lengthTimestep = 1
+factors = [2, 5, 10, 30, 90]
+
+# straight coast with a gentle undulation, land at the high rows
+def make_grid():
+    grid = ((POINTER(c_double)) * nRows)()
+    for r in range(nRows):
+        grid[r] = (c_double * nCols)()
+        for c in range(nCols):
+            shore = nRows // 3 + 0.5 + 1.5 * math.sin(2 * math.pi * c / 50)
+            grid[r][c] = min(1.0, max(0.0, r + 1 - shore))
+    return grid
+
+# cross-shore position of the shoreline in every column, in cells of sand
+def get_positions(grid_at):
+    return [sum(grid_at(r, c) for r in range(nRows)) for c in range(nCols)]
+
+def run(records, factor, queue):
+    lib = CDLL(lib_path)
+    lib.initialize.argtypes = [config.Config]
+    lib.initialize.restype = c_int
+    lib.step.argtypes = [c_int]
+    lib.step.restype = c_int
+    lib.raster.restype = config.Raster
+    lib.finalize.restype = c_int
+
+    numTimesteps = len(records)
+    waveHeights = (c_double * numTimesteps)(*[h for h, t, a in records])
+    wavePeriods = (c_double * numTimesteps)(*[t for h, t, a in records])
+    waveAngles = (c_double * numTimesteps)(*[a for h, t, a in records])
+    input = config.Config(grid = make_grid(), waveHeights = waveHeights, waveAngles = waveAngles, wavePeriods = wavePeriods,
+            asymmetry = -1, stability = -1, numWaveInputs = numTimesteps,
+            nRows = nRows, nCols = nCols, cellWidth = cellWidth, cellLength = cellLength,
+            shelfSlope = 0.001, shorefaceSlope = 0.01, crossShoreReferencePos = 10,
+            shelfDepthAtReferencePos = 10, minimumShelfDepthAtClosure = 10, depthOfClosure = 10,
+            sedMobility = 1, lengthTimestep = lengthTimestep, saveInterval = numTimesteps, numTimesteps = numTimesteps,
+            engine = 1, adaptiveTimestep = 1, morphologicalFactor = factor)
+    start = time.time()
+    if lib.initialize(input) != 0 or lib.step(numTimesteps) != 0:
+        queue.put(None)
+        return
+    elapsed = time.time() - start
+    raster = lib.raster()
+    queue.put((get_positions(lambda r, c: raster.data[r * raster.rowStride + c]), elapsed))
+    lib.finalize()
+
+def run_isolated(records, factor):
+    queue = Queue()
+    process = Process(target = run, args = (records, factor, queue))
+    process.start()
+    process.join()
+    return queue.get() if process.exitcode == 0 else None
+
+# RETURN: whether the run failed
+def print_diff(name, factor, steps, result, full):
+    if result is None:
+        print("%-10s %6d %7d   failed" % (name, factor, steps))
+        return True
+    positions, elapsed = result
+    diffs = [abs(a - b) for a, b in zip(positions, full)]
+    print("%-10s %6d %7d %10.3f %13.4f %12.4f" % (name, factor, steps, elapsed, sum(diffs) / nCols, max(diffs)))
+    return False
+
+if __name__ == "__main__":
+    # daily wave height, period, angle to shore normal
+    records = []
+    for line in open("test/wis63436.txt"):
+        height, period, angle, spread = line.split(',')
+        records.append((float(height), float(period), float(angle)))
+    records = records[:365 * years]
+    numTimesteps = len(records)
+
+    full = run_isolated(records, 1)
+    if full is None:
+        print("full record run failed")
+        sys.exit(1)
+    initial = make_grid()
+    change = get_positions(lambda r, c: initial[r][c])
+
+    print("days: " + str(numTimesteps) + "   columns: " + str(nCols) + "   cell: " + str(cellWidth) + " m")
+    print("run        factor   steps   time (s)   mean |diff|   max |diff|  (cells)")
+    print_diff("full", 1, numTimesteps, full, full[0])
+    print_diff("change", 1, numTimesteps, (change, 0), full[0])
+    shuffled = list(records)
+    random.Random(5).shuffle(shuffled)
+    failures = print_diff("shuffled", 1, numTimesteps, run_isolated(shuffled, 1), full[0])
+    for factor in factors:
+        failures += print_diff("condensed", factor, (numTimesteps + factor - 1) // factor, run_isolated(records, factor), full[0])
+    sys.exit(1 if failures else 0)
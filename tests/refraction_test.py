@@ -0,0 +1,74 @@
+from ctypes import *
+import math
+import sys
+
+# Checks the transport potentials of REFRACTION_VECTOR against REFRACTION_MARCH
+# over deep water angles from shore normal out past the steepest one the
+# model refracts, and over wave heights and periods. Every march kernel the
+# CPU runs is checked against the scalar one, which it should match bit for
+# bit, in batches of every size up to two AVX-512 widths so each kernel's
+# leftover nodes are marched too.
+# usage: python refraction_test.py [library path]
+
+lib_path = sys.argv[1] if len(sys.argv) > 1 else "../server/C/_build/py_cem"
+
+REFRACTION_MARCH = 0
+REFRACTION_VECTOR = 3
+kernels = [(1, "scalar"), (4, "AVX2"), (8, "AVX-512")]
+heights = [0.3, 0.7, 1.5, 2.5, 4.0]
+periods = [3, 6, 10, 16]
+tolerance = 1e-9        # of the largest potential of a wave
+
+# 0, the steepest angle refracted (0.995 * pi / 2), steeper ones and a sweep
+steepest = 0.995 * math.pi / 2
+angles = [0.0, steepest, -steepest, 0.999 * math.pi / 2, -0.999 * math.pi / 2, math.pi / 2, -math.pi / 2]
+angles += [-math.pi / 2 + math.pi * i / 1000 for i in range(1001)]
+
+lib = CDLL(lib_path)
+lib.transport_potentials.argtypes = [c_int, c_int, c_double, c_double, POINTER(c_double), c_int, POINTER(c_double)]
+lib.transport_potentials.restype = c_int
+
+# RETURN: potentials of the angles, None if the CPU does not run the kernel
+def get_potentials(mode, kernel, height, period, alpha_deep):
+    alphas = (c_double * len(alpha_deep))(*alpha_deep)
+    potentials = (c_double * len(alpha_deep))()
+    if lib.transport_potentials(mode, kernel, height, period, alphas, len(alpha_deep), potentials) != 0:
+        return None
+    return list(potentials)
+
+# potentials of the angles marched in batches of every size from 1 to 16 in turn
+def get_batched_potentials(kernel, height, period):
+    potentials = []
+    start, size = 0, 1
+    while start < len(angles):
+        potentials += get_potentials(REFRACTION_VECTOR, kernel, height, period, angles[start:start + size])
+        start += size
+        size = size % 16 + 1
+    return potentials
+
+if __name__ == "__main__":
+    failures = 0
+    print("kernel     worst |vector - march| / largest   batched   result")
+    for kernel, name in kernels:
+        if get_potentials(REFRACTION_VECTOR, kernel, 1, 8, [0.1]) is None:
+            print("%-10s not run by this CPU" % name)
+            continue
+        worst = 0
+        is_batched_same = True
+        for height in heights:
+            for period in periods:
+                march = get_potentials(REFRACTION_MARCH, 0, height, period, angles)
+                vector = get_potentials(REFRACTION_VECTOR, kernel, height, period, angles)
+                scalar = get_potentials(REFRACTION_VECTOR, 1, height, period, angles)
+                largest = max(march)
+                for alpha, a, b in zip(angles, march, vector):
+                    diff = abs(a - b) / largest
+                    if diff > tolerance:
+                        print("  H %g T %g alpha %.6f: march %g vector %g" % (height, period, alpha, a, b))
+                    worst = max(worst, diff)
+                is_batched_same = is_batched_same and vector == scalar \
+                    and get_batched_potentials(kernel, height, period) == scalar
+        ok = worst <= tolerance and is_batched_same
+        failures += not ok
+        print("%-10s %32.3g   %7s   %s" % (name, worst, "same" if is_batched_same else "DIFF", "ok" if ok else "FAILED"))
+    sys.exit(1 if failures else 0)